@@ -1,28 +1,51 @@
 #pragma once
 
 #include "SPSCQueue.h"
+#include "arena.h"
+#include "executor.h"
+#include "trace.h"
+#include <atomic>
+#include <cassert>
+#include <coroutine>
+#include <memory>
 #include <optional>
 #include <semaphore>
+#include <utility>
+
+// The static footprint profile serves every queue from the locked arena
+#ifdef STATIC_FOOTPRINT
+template <typename T> using QueueAllocator = ArenaAllocator<T>;
+#else
+template <typename T> using QueueAllocator = std::allocator<T>;
+#endif
 
 template <typename T> class MsgQueue {
 public:
-  MsgQueue(size_t queue_sz) : queue(rigtorp::SPSCQueue<T>(queue_sz)), sem(0) {};
+  MsgQueue(size_t queue_sz) : queue(queue_sz), sem(0) {};
 
   ~MsgQueue() = default;
 
   void close() {
     closed = true;
     sem.release();
+    wake_waiter();
   }
 
-  bool send(const T &data) {
+  bool send(const T &data) { return emplace(data); };
+
+  // Constructs the message in its slot, saves a copy for large messages
+  template <typename... Args> bool emplace(Args &&...args) {
+    TRACE_SCOPE("MsgQueue::send");
+
     if (closed)
       return false;
 
-    bool result = queue.try_emplace(data);
+    bool result = queue.try_emplace(std::forward<Args>(args)...);
 
-    if (result)
+    if (result) {
       sem.release();
+      wake_waiter();
+    }
     return result;
   };
 
@@ -37,12 +60,71 @@ public:
       }
       if (closed)
         return std::nullopt;
+      TRACE_BEGIN("MsgQueue::recv wait");
       sem.acquire();
+      TRACE_END("MsgQueue::recv wait");
+    }
+  };
+
+  // co_await queue.async_recv() from a Task: like recv(), but suspends the
+  // coroutine instead of blocking its executor thread
+  class RecvAwaiter {
+  public:
+    explicit RecvAwaiter(MsgQueue *queue) : queue(queue) {}
+
+    bool await_ready() const { return queue->queue.front() || queue->closed; }
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+      node.handle = handle;
+      node.worker = Executor::current();
+      assert(node.worker && "async_recv() outside of an Executor");
+
+      queue->waiter.store(&node, std::memory_order_release);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (!await_ready())
+        return true;
+
+      // A message raced in. Resume at once, unless the producer already
+      // took the node and scheduled us.
+      return queue->waiter.exchange(nullptr, std::memory_order_acq_rel) !=
+             &node;
     }
+
+    std::optional<T> await_resume() {
+      if (auto ptr = queue->queue.front()) {
+        T val = std::move(*ptr);
+        queue->queue.pop();
+        return val;
+      }
+      return std::nullopt;
+    }
+
+  private:
+    MsgQueue *queue;
+    ExecutorNode node;
   };
 
+  RecvAwaiter async_recv() { return RecvAwaiter(this); }
+
+  size_t size() const { return queue.size(); }
+
+  size_t capacity() const { return queue.capacity(); }
+
 private:
-  rigtorp::SPSCQueue<T> queue;
+  rigtorp::SPSCQueue<T, QueueAllocator<T>> queue;
+  // Pairs with the fence in RecvAwaiter::await_suspend(): either the
+  // consumer sees the new message or the producer sees the waiter
+  void wake_waiter() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!waiter.load(std::memory_order_relaxed))
+      return;
+    ExecutorNode *node = waiter.exchange(nullptr, std::memory_order_acq_rel);
+    if (node)
+      Executor::schedule(node);
+  }
+
   std::binary_semaphore sem;
-  bool closed = false;
+  std::atomic<bool> closed = false;
+  // Coroutine suspended in async_recv(), if any
+  std::atomic<ExecutorNode *> waiter = nullptr;
 };
\ No newline at end of file
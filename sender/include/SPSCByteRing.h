@@ -0,0 +1,186 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+
+// Single producer single consumer ring of variable size records. Each
+// record is an 8 byte header (payload size and a caller defined kind)
+// followed by its payload, padded to 8 bytes, so a 1 byte SID marker takes
+// 16 bytes instead of a whole Codec2Data slot.
+//
+// The producer reserves space, writes the payload in place and commits.
+// A record never straddles the end of the buffer: when the tail is too
+// short the producer leaves a wrap marker there and starts over at offset
+// 0. Positions are 64 bit byte counters that never wrap, each side keeps a
+// cached copy of the other's, laid out on separate cache lines as in
+// rigtorp::SPSCQueue.
+template <typename Allocator = std::allocator<uint8_t>> class SPSCByteRing {
+public:
+  struct Record {
+    uint32_t kind;
+    std::span<const uint8_t> payload;
+  };
+
+  explicit SPSCByteRing(size_t capacity,
+                        const Allocator &allocator = Allocator())
+      : capacity_(align(capacity)), allocator_(allocator) {
+    if (capacity_ < 4 * kHeaderSize)
+      throw std::invalid_argument("SPSCByteRing capacity too small");
+
+    // Padding on both sides keeps neighbouring allocations off our lines
+    storage_ = std::allocator_traits<Allocator>::allocate(
+        allocator_, capacity_ + 2 * kCacheLineSize);
+    buffer_ = storage_ + kCacheLineSize;
+  }
+
+  ~SPSCByteRing() {
+    std::allocator_traits<Allocator>::deallocate(
+        allocator_, storage_, capacity_ + 2 * kCacheLineSize);
+  }
+
+  SPSCByteRing(const SPSCByteRing &) = delete;
+  SPSCByteRing &operator=(const SPSCByteRing &) = delete;
+
+  // Largest payload that is always accepted by an empty ring
+  size_t max_payload() const noexcept {
+    return capacity_ / 2 - kHeaderSize;
+  }
+
+  // Returns room for size payload bytes, or nullptr if the ring is too
+  // full. Only one reservation may be open, commit() publishes it.
+  uint8_t *reserve(size_t size) noexcept {
+    assert(size <= max_payload());
+
+    size_t need = align(kHeaderSize + size);
+    uint64_t write_pos = writePos_.load(std::memory_order_relaxed);
+    size_t offset = write_pos % capacity_;
+    size_t tail = capacity_ - offset;
+    size_t skip = tail < need ? tail : 0;
+
+    if (write_pos + skip + need - readPosCache_ > capacity_) {
+      readPosCache_ = readPos_.load(std::memory_order_acquire);
+      if (write_pos + skip + need - readPosCache_ > capacity_)
+        return nullptr;
+    }
+
+    if (skip) {
+      store_header(offset, kWrap, 0);
+      offset = 0;
+    }
+
+    reserved_ = size;
+    reservedSkip_ = skip;
+    return buffer_ + offset + kHeaderSize;
+  }
+
+  // Publishes the open reservation with size bytes, at most what was
+  // reserved
+  void commit(size_t size, uint32_t kind = 0) noexcept {
+    assert(size <= reserved_);
+
+    uint64_t write_pos =
+        writePos_.load(std::memory_order_relaxed) + reservedSkip_;
+    store_header(write_pos % capacity_, static_cast<uint32_t>(size), kind);
+    writePos_.store(write_pos + align(kHeaderSize + size),
+                    std::memory_order_release);
+  }
+
+  bool try_push(const void *data, size_t size, uint32_t kind = 0) noexcept {
+    uint8_t *dst = reserve(size);
+    if (!dst)
+      return false;
+    memcpy(dst, data, size);
+    commit(size, kind);
+    return true;
+  }
+
+  // The oldest record, if any
+  std::optional<Record> front() noexcept {
+    uint64_t read_pos = readPos_.load(std::memory_order_relaxed);
+    if (read_pos == writePosCache_) {
+      writePosCache_ = writePos_.load(std::memory_order_acquire);
+      if (read_pos == writePosCache_)
+        return std::nullopt;
+    }
+
+    size_t offset = read_pos % capacity_;
+    uint32_t size, kind;
+    load_header(offset, size, kind);
+
+    // The producer went back to the start, a record always follows
+    if (size == kWrap) {
+      read_pos += capacity_ - offset;
+      readPos_.store(read_pos, std::memory_order_release);
+      offset = 0;
+      load_header(offset, size, kind);
+    }
+
+    return Record{kind, {buffer_ + offset + kHeaderSize, size}};
+  }
+
+  // Frees the record returned by the last front()
+  void pop() noexcept {
+    uint64_t read_pos = readPos_.load(std::memory_order_relaxed);
+    uint32_t size, kind;
+    load_header(read_pos % capacity_, size, kind);
+    assert(size != kWrap && read_pos != writePos_.load());
+
+    readPos_.store(read_pos + align(kHeaderSize + size),
+                   std::memory_order_release);
+  }
+
+  // Bytes in use, including headers and padding. The read position goes
+  // first: both only grow, so the write position loaded after it is never
+  // behind it and the difference cannot underflow.
+  size_t size() const noexcept {
+    uint64_t read_pos = readPos_.load(std::memory_order_acquire);
+    uint64_t write_pos = writePos_.load(std::memory_order_acquire);
+    return write_pos - read_pos;
+  }
+
+  bool empty() const noexcept { return size() == 0; }
+
+  size_t capacity() const noexcept { return capacity_; }
+
+private:
+  static constexpr size_t kHeaderSize = 8;
+  static constexpr uint32_t kWrap = UINT32_MAX;
+
+  // Fixed rather than std::hardware_destructive_interference_size, whose
+  // value may change between compiler versions and flags and so must not
+  // shape a layout
+  static constexpr size_t kCacheLineSize = 64;
+
+  static constexpr size_t align(size_t n) noexcept { return (n + 7) & ~7ul; }
+
+  void store_header(size_t offset, uint32_t size, uint32_t kind) noexcept {
+    memcpy(buffer_ + offset, &size, sizeof(size));
+    memcpy(buffer_ + offset + sizeof(size), &kind, sizeof(kind));
+  }
+
+  void load_header(size_t offset, uint32_t &size,
+                   uint32_t &kind) const noexcept {
+    memcpy(&size, buffer_ + offset, sizeof(size));
+    memcpy(&kind, buffer_ + offset + sizeof(size), sizeof(kind));
+  }
+
+  size_t capacity_;
+  uint8_t *storage_;
+  uint8_t *buffer_;
+  Allocator allocator_;
+
+  alignas(kCacheLineSize) std::atomic<uint64_t> writePos_ = {0};
+  alignas(kCacheLineSize) uint64_t readPosCache_ = 0;
+  // Open reservation, producer only
+  size_t reserved_ = 0;
+  size_t reservedSkip_ = 0;
+  alignas(kCacheLineSize) std::atomic<uint64_t> readPos_ = {0};
+  alignas(kCacheLineSize) uint64_t writePosCache_ = 0;
+};
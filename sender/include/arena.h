@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+
+// One region reserved, prefaulted and locked at startup that backs every
+// queue of the pipeline when the static footprint profile is enabled.
+// Allocation is a bump of an offset. Blocks given back go on a free list
+// and serve later requests of exactly their size: a device that replaces an
+// expired one allocates the same queues and takes over its memory.
+
+// Reserves and locks the arena, must run before the first allocation or the
+// arena sizes itself for FOOTPRINT_MAX_STREAMS on first use
+void arena_init(size_t bytes);
+
+// Throws std::bad_alloc once the arena is exhausted. Not for the real-time
+// path, reusing a freed block takes a lock.
+void *arena_allocate(size_t bytes, size_t alignment);
+
+// Returns a block from arena_allocate() with the same size and alignment
+void arena_deallocate(void *p, size_t bytes, size_t alignment);
+
+size_t arena_capacity();
+size_t arena_used();
+bool arena_locked();
+
+// Standard allocator over the arena
+template <typename T> struct ArenaAllocator {
+  using value_type = T;
+
+  ArenaAllocator() noexcept = default;
+  template <typename U> ArenaAllocator(const ArenaAllocator<U> &) noexcept {}
+
+  T *allocate(size_t n) {
+    return static_cast<T *>(arena_allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T *p, size_t n) noexcept {
+    arena_deallocate(p, n * sizeof(T), alignof(T));
+  }
+
+  template <typename U> bool operator==(const ArenaAllocator<U> &) const {
+    return true;
+  }
+};
+
+#ifdef __cpp_lib_hardware_interference_size
+#define ARENA_CACHE_LINE std::hardware_destructive_interference_size
+#else
+#define ARENA_CACHE_LINE 64
+#endif
+
+// Arena bytes taken by the slots of a rigtorp::SPSCQueue<T> of the given
+// capacity, mirrors its slack element and padding
+template <typename T> constexpr size_t arena_queue_bytes(size_t capacity) {
+  size_t padding = (ARENA_CACHE_LINE - 1) / sizeof(T) + 1;
+  size_t bytes = (capacity + 1 + 2 * padding) * sizeof(T);
+  return (bytes + ARENA_CACHE_LINE - 1) & ~size_t(ARENA_CACHE_LINE - 1);
+}
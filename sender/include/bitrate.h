@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+
+#include "config.h"
+#include "data.h"
+
+// Duration of one PcmData frame, the real-time budget of the encoder
+#define FRAME_PERIOD_NS 40000000ull
+
+// Defaults of the bitrate_* settings in config.h
+
+// Queue fill above which a frame counts as under pressure
+#define BITRATE_HIGH_WATER 0.5
+// Queue fill below which a frame counts as calm
+#define BITRATE_LOW_WATER 0.125
+// Encode time, as a fraction of the frame period, considered too slow
+#define BITRATE_ENCODE_HIGH 0.5
+#define BITRATE_ENCODE_LOW 0.25
+// Consecutive pressured frames before stepping down one mode
+#define BITRATE_DOWN_FRAMES 3
+// Consecutive calm frames before stepping up one mode
+#define BITRATE_UP_FRAMES 50
+
+struct BitrateSample {
+  size_t pcm_depth;
+  size_t pcm_capacity;
+  size_t out_depth;
+  size_t out_capacity;
+  uint64_t encode_ns;
+  bool dropped;
+};
+
+// Moves the encoder along CODEC2_MODES based on queue depth and encode time,
+// with hysteresis so short bursts do not cause the mode to flap. Never goes
+// above config.codec2_mode: the queues only show local backlog, not what
+// the link can carry.
+class BitrateController {
+public:
+  explicit BitrateController(int initial_mode);
+
+  int mode() const { return CODEC2_MODES[this->idx]; }
+
+  // Called once per encoded frame, returns the mode for the next frame
+  int update(const BitrateSample &sample, const Config &config);
+
+  void report() const;
+
+private:
+  int idx;
+  uint32_t pressured = 0;
+  uint32_t calm = 0;
+
+  uint64_t deadline_misses = 0;
+  uint64_t switches = 0;
+  uint64_t frames[CODEC2_MODES_N] = {0};
+};
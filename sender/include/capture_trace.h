@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MsgQueue.h"
+
+// Capture callbacks recorded with -DSENDER_CAPTURE_RECORD=ON
+#define CAPTURE_RECORD_OUTPUT "capture-trace.bin"
+
+// Largest callback recorded, larger ones are counted and dropped
+#define CAPTURE_RECORD_SAMPLES_MAX 4096
+// Callbacks buffered between the capture thread and the file writer
+#define CAPTURE_RECORD_QUEUE_SIZE 128
+
+// Trace file layout, host endianness: one CaptureTraceHeader, then per
+// capture callback a CaptureTraceRecord followed by its n_samples mono S16
+// samples
+struct CaptureTraceHeader {
+  char magic[8] = {'S', 'B', 'C', 'C', 'A', 'P', 'T', 'R'};
+  uint32_t version = 1;
+  uint32_t sample_rate = 8000;
+};
+
+struct CaptureTraceRecord {
+  uint64_t timestamp_ns; // steady clock when the callback started
+  uint32_t stream_id;
+  uint32_t n_samples;
+};
+
+// Logs every capture callback as delivered. The callback only copies into
+// a preallocated queue, a thread of its own writes the file.
+class CaptureRecorder {
+public:
+  CaptureRecorder(const std::string &path);
+
+  // Writes what is still queued and closes the file. Capture must have
+  // stopped.
+  ~CaptureRecorder();
+
+  // Never blocks or allocates. All callers must share one thread, as the
+  // capture streams share the PipeWire data loop.
+  void record(uint32_t stream_id, uint64_t timestamp_ns,
+              const int16_t *samples, uint32_t n_samples);
+
+  // Arena bytes taken by the queue, see footprint.h
+  static size_t arena_bytes();
+
+private:
+  struct Chunk {
+    Chunk(uint32_t stream_id, uint64_t timestamp_ns, const int16_t *samples,
+          uint32_t n_samples)
+        : record{timestamp_ns, stream_id, n_samples} {
+      memcpy(this->samples, samples, n_samples * sizeof(int16_t));
+    }
+
+    CaptureTraceRecord record;
+    int16_t samples[CAPTURE_RECORD_SAMPLES_MAX];
+  };
+
+  void write();
+
+  std::ofstream fs;
+  MsgQueue<Chunk> chunks{CAPTURE_RECORD_QUEUE_SIZE};
+  std::thread writer;
+
+  // Capture thread only, read once it stopped
+  uint64_t dropped = 0;
+  uint64_t recorded = 0;
+};
+
+// Reads back a trace written by CaptureRecorder
+class CaptureReplay {
+public:
+  CaptureReplay(const std::string &path);
+
+  // Next callback of the trace, false at its end
+  bool next(CaptureTraceRecord &record, std::vector<int16_t> &samples);
+
+private:
+  std::ifstream fs;
+};
@@ -0,0 +1,13 @@
+#pragma once
+
+// How the linked codec2 was compiled. SENDER_CODEC2_OPTIMIZED defines
+// CODEC2_OPTIMIZED, SENDER_CODEC2_ISA defines CODEC2_ISA to the instruction
+// set it targets, e.g. "x86-64-v3". Both only change compiler flags, the
+// FFT and analysis code are codec2's own.
+
+// "stock", "optimized" or "optimized for <isa>", for reports
+const char *codec2_build_name();
+
+// Throws when codec2 was built for an instruction set this CPU lacks, so
+// the sender stops with a message instead of SIGILL in the first frame
+void codec2_build_check();
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <semaphore>
+#include <thread>
+
+#include "MsgQueue.h"
+#include "SPSCQueue.h"
+#include "codec2.h"
+#include "data.h"
+
+// Warm codec instances kept ready per mode
+#define CODEC2_POOL_SIZE 2
+// Released codecs waiting for the refill thread
+#define CODEC2_POOL_USED_QUEUE_SIZE (CODEC2_MODES_N * CODEC2_POOL_SIZE * 2)
+// How often the refill thread looks for released codecs. Sessions are at
+// least a pause apart, so this only has to beat the next session start.
+// Taking the last ready codec of a mode wakes it at once.
+#define CODEC2_POOL_REFILL_MS 50
+
+// Hands out freshly created and warmed CODEC2 instances so a new session
+// never pays for codec2_create. Used instances are destroyed and replaced by
+// a background thread that polls for them, so handing one back is a queue
+// push without a wakeup syscall unless the pool runs low. One consumer
+// thread only.
+class Codec2Pool {
+public:
+  Codec2Pool();
+  ~Codec2Pool();
+
+  // Never blocks, creates the codec inline if the pool ran dry
+  CODEC2 *acquire(int idx);
+
+  // Gives back a codec whose state belongs to a finished session
+  void release(CODEC2 *codec2);
+
+  uint64_t misses() const { return misses_; }
+
+  // Arena bytes taken by the queues of one pool
+  static size_t arena_bytes();
+
+  // Heap taken by one warmed codec state of a mode, measured by creating one
+  static size_t state_bytes(int idx);
+
+private:
+  static CODEC2 *create_warm(int idx);
+
+  void refill();
+
+  std::unique_ptr<rigtorp::SPSCQueue<CODEC2 *, QueueAllocator<CODEC2 *>>>
+      ready[CODEC2_MODES_N];
+  rigtorp::SPSCQueue<CODEC2 *, QueueAllocator<CODEC2 *>> used{
+      CODEC2_POOL_USED_QUEUE_SIZE};
+  std::binary_semaphore wake{0};
+  std::atomic<bool> stopping = false;
+  std::thread refiller;
+
+  uint64_t misses_ = 0;
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Read at startup, again on SIGHUP or a POST /reload to the metrics socket
+#define CONFIG_PATH "sender.conf"
+
+// Runtime tunables. The file holds "key = value" lines named after the
+// fields, '#' starts a comment, missing keys keep their compiled-in
+// default. Per-frame settings apply from the next frame, codec2_mode,
+// queue sizes and the capture filter to devices opened afterwards.
+struct Config {
+  // 3200, 2400, 1300 or 700C: the mode new streams start at and the
+  // highest one the bitrate controller may use. It only steps between this
+  // and 700C, so the default never grows past the 4 byte LoRa slot. The
+  // fixed mode when adaptive bitrate is compiled out.
+  int codec2_mode;
+  uint32_t session_silence_samples;
+  uint32_t pcm_queue_size;
+  uint32_t codec2_queue_size;
+
+  int dtx_silence_dbfs;
+  uint32_t dtx_hangover_frames;
+  uint32_t dtx_sid_interval;
+
+  double bitrate_high_water;
+  double bitrate_low_water;
+  double bitrate_encode_high;
+  double bitrate_encode_low;
+  uint32_t bitrate_down_frames;
+  uint32_t bitrate_up_frames;
+
+  std::string capture_match;
+  std::string capture_device_api;
+
+  // Thread placement, see thread_profile.h. Applies to threads started
+  // afterwards, mlockall only at startup.
+  int thread_capture_priority;
+  int thread_capture_cpu;
+  int thread_encoder_priority;
+  int thread_encoder_cpu;
+  int thread_decoder_priority;
+  int thread_decoder_cpu;
+  int thread_pool_priority;
+  int thread_pool_cpu;
+  uint32_t thread_mlockall;
+};
+
+// The values of the macros next to each setting
+Config config_defaults();
+
+// Reads path over the defaults and validates the result. Throws
+// std::runtime_error naming the offending line or setting.
+Config config_parse(const std::string &path);
+
+// Loads path, or keeps the defaults if it does not exist, and remembers it
+// for config_reload(). Throws if the file is invalid.
+void config_init(const std::string &path);
+
+// The current snapshot, never null. Lock-free, safe on the capture thread.
+// Snapshots are immutable and live until exit, so the pointer stays valid
+// across reloads; read it once per frame for a consistent view.
+const Config *config_current();
+
+// Publishes the file given to config_init() if it is valid, otherwise
+// keeps the current snapshot and returns false with the reason in error.
+// Blocks on file I/O, never call it from the real-time path.
+bool config_reload(std::string &error);
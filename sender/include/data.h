@@ -5,36 +5,53 @@
 
 #include "codec2.h"
 
+// Mode streams start at and the ceiling of the bitrate controller, which
+// may step down the modes in CODEC2_MODES and back. Default of codec2_mode
+// in config.h.
 #define CODEC2_MODE CODEC2_MODE_700C
 
-#if CODEC2_MODE==CODEC2_MODE_700C
+// Capture frames are always 40 ms, modes with 20 ms codec frames
+// (3200, 2400) encode two codec frames per PcmData
 #define PCM_SAMPLE_MAX 320
-#define CODEC2_FRAME_MAX 4
-#endif
 
-#if CODEC2_MODE==CODEC2_MODE_1300
-#define PCM_SAMPLE_MAX 320
-#define CODEC2_FRAME_MAX 7
-#endif
+// Largest encoded 40 ms frame: two 8 byte frames of 3200
+#define CODEC2_FRAME_MAX 16
 
-#if CODEC2_MODE==CODEC2_MODE_2400
-#define PCM_SAMPLE_MAX 160
-#define CODEC2_FRAME_MAX 6
-#endif
+// Modes the encoder can switch between, highest bitrate first
+#define CODEC2_MODES_N 4
+constexpr int CODEC2_MODES[CODEC2_MODES_N] = {
+    CODEC2_MODE_3200, CODEC2_MODE_2400, CODEC2_MODE_1300, CODEC2_MODE_700C};
 
-#if CODEC2_MODE==CODEC2_MODE_3200
-#define PCM_SAMPLE_MAX 160
-#define CODEC2_FRAME_MAX 8
-#endif
+constexpr int codec2_mode_index(int mode) {
+    for (int i = 0; i < CODEC2_MODES_N; ++i)
+        if (CODEC2_MODES[i] == mode)
+            return i;
+    return -1;
+}
 
+static_assert(codec2_mode_index(CODEC2_MODE) >= 0,
+              "CODEC2_MODE must be one of CODEC2_MODES");
 
 struct PcmData {
+    uint32_t stream_id; // capture device the frame came from
     uint32_t session_id;
     uint32_t piece_id;
+    uint64_t timestamp_ns; // steady clock, set when the frame is emitted
     uint32_t samples_n;
     int16_t samples[PCM_SAMPLE_MAX];
 };
 
+enum class FrameType : uint8_t {
+    Voice = 0,
+    Sid = 1, // silence descriptor, bytes[0] carries the noise level
+};
+
 struct Codec2Data {
+    uint32_t stream_id;
+    uint32_t session_id;
+    uint32_t piece_id;
+    FrameType type;
+    uint8_t mode; // codec2 mode of a Voice frame, the decoder follows it
+    uint8_t n_bytes;
     uint8_t bytes[CODEC2_FRAME_MAX];
 };
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+
+#include "config.h"
+#include "data.h"
+
+// Defaults of the dtx_* settings in config.h
+
+// Frames whose RMS level is below this are treated as silence
+#define DTX_SILENCE_DBFS -55
+// Keep sending voice frames for this many silent frames after speech
+#define DTX_HANGOVER_FRAMES 4
+// While silent, refresh the comfort noise level every N frames
+#define DTX_SID_INTERVAL 8
+
+// Discontinuous transmission: decides per frame whether to encode it,
+// replace it by a SID marker, or drop it entirely
+class Dtx {
+public:
+  enum class Decision { Voice, Sid, Suppress };
+
+  Decision update(const PcmData &pcm_data, const Config &config);
+
+  Codec2Data sid_frame(const PcmData &pcm_data) const;
+
+  void add_encoded(uint64_t ns, uint32_t n_bytes);
+
+  void report() const;
+
+private:
+  uint32_t session_id = UINT32_MAX;
+  uint32_t hangover = 0;
+  uint32_t since_sid = 0;
+  bool silent = false;
+
+  // Last measured level, in dBFS + 128
+  uint8_t level = 0;
+
+  uint64_t frames_voice = 0;
+  uint64_t frames_sid = 0;
+  uint64_t frames_suppressed = 0;
+  uint64_t encode_ns = 0;
+  uint64_t bytes_voice = 0;
+};
+
+// Decoder side: fills the gaps left by DTX with noise at the SID level
+class ComfortNoise {
+public:
+  void set_level(uint8_t level);
+
+  PcmData generate(uint32_t stream_id, uint32_t session_id,
+                   uint32_t piece_id);
+
+private:
+  float rms = 0;
+  uint32_t seed = 0x12345678;
+};
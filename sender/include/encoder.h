@@ -2,20 +2,50 @@
 
 // #include <codec2/codec2.h>
 #include "codec2.h"
+#include "codec2_pool.h"
 #include "data.h"
 
+#include <memory>
+
+// Take fresh codec states from a pre-warmed pool at session boundaries,
+// without it they are re-created inline
+#define ENCODER_CODEC2_POOL 1
+
 class Encoder {
 public:
-  Encoder();
+  // pooled takes fresh states from a pre-warmed pool with its own refill
+  // thread. Decode-only instances off the real-time path go without and
+  // re-create states inline.
+  explicit Encoder(bool pooled = true);
 
   ~Encoder();
 
-  Codec2Data encode(PcmData &pcm_data);
+  Codec2Data encode(PcmData &pcm_data, int mode = CODEC2_MODE);
 
   PcmData decode(Codec2Data &codec2_data);
 
+  uint64_t pool_misses() const;
+
 private:
-  CODEC2 *codec2;
-  size_t nsam;
-  size_t bytes_per_frame;
+  // Starts every mode used by the previous session from a clean state
+  void begin_session(uint32_t stream_id, uint32_t session_id);
+
+  CODEC2 *codec(int idx);
+
+  // A new state for mode idx, from the pool if there is one
+  CODEC2 *fresh_state(int idx);
+
+#ifdef ENCODER_CODEC2_POOL
+  // nullptr when not pooled
+  std::unique_ptr<Codec2Pool> pool;
+#endif
+
+  // One codec state per entry of CODEC2_MODES
+  CODEC2 *codec2[CODEC2_MODES_N];
+  bool used[CODEC2_MODES_N] = {false};
+  size_t nsam[CODEC2_MODES_N];
+  size_t bytes_per_frame[CODEC2_MODES_N];
+
+  uint32_t stream_id = UINT32_MAX;
+  uint32_t session_id = UINT32_MAX;
 };
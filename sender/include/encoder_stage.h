@@ -0,0 +1,46 @@
+#pragma once
+
+#include "MsgQueue.h"
+#include "bitrate.h"
+#include "config.h"
+#include "data.h"
+#include "dtx.h"
+#include "encoder.h"
+#include "metrics.h"
+#include "thread_profile.h"
+
+#define ENCODER_DTX 1
+#define ENCODER_ADAPTIVE_BITRATE 1
+
+// Encoder side of the pipeline: DTX, Codec2 encoding and bitrate control
+// for the frames of one capture stream
+class EncoderStage {
+public:
+  EncoderStage(MsgQueue<PcmData> *pcm_queue,
+               MsgQueue<Codec2Data> *codec2_queue, StageMetrics *metrics);
+
+  // Handles one frame, never blocks or allocates
+  void process(PcmData &data);
+
+  // Processes frames until pcm_queue is closed
+  void run();
+
+  void report() const;
+
+private:
+  MsgQueue<PcmData> *pcm_queue;
+  MsgQueue<Codec2Data> *codec2_queue;
+  StageMetrics *metrics;
+
+  Encoder encoder;
+  int mode = config_current()->codec2_mode;
+  uint32_t session_id = UINT32_MAX;
+  JitterMeter jitter{metrics};
+  uint32_t jitter_session = UINT32_MAX;
+#ifdef ENCODER_DTX
+  Dtx dtx;
+#endif
+#ifdef ENCODER_ADAPTIVE_BITRATE
+  BitrateController bitrate{mode};
+#endif
+};
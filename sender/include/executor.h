@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "thread_profile.h"
+
+// Threads of the executor the pipelines share for their I/O-bound stages
+#define EXECUTOR_THREADS 2
+
+class Executor;
+class ExecutorWorker;
+
+// A suspended coroutine waiting to run. Lives in whatever suspended it, so
+// making it runnable never allocates.
+struct ExecutorNode {
+  std::coroutine_handle<> handle;
+  ExecutorWorker *worker = nullptr;
+  ExecutorNode *next = nullptr;
+};
+
+// A detached coroutine for Executor::spawn(). Its frame is freed when it
+// returns, an exception escaping it terminates like one escaping a thread.
+class Task {
+public:
+  struct promise_type {
+    Executor *executor = nullptr;
+    ExecutorNode start;
+
+    Task get_return_object() {
+      return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    auto final_suspend() noexcept;
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+
+  Task(Task &&other) noexcept : handle(std::exchange(other.handle, {})) {}
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+
+  // Never spawned, never started
+  ~Task() {
+    if (handle)
+      handle.destroy();
+  }
+
+private:
+  explicit Task(std::coroutine_handle<promise_type> handle)
+      : handle(handle) {}
+
+  friend class Executor;
+  std::coroutine_handle<promise_type> handle;
+};
+
+// Runs coroutines on a few threads. Each coroutine stays on the worker it
+// was spawned on; it suspends on an awaitable such as
+// MsgQueue::async_recv() and the awaitable's producer schedules it again.
+class Executor {
+public:
+  // Workers apply the placement of stage when they start
+  Executor(size_t threads, ThreadStage stage);
+
+  // Waits for every spawned task to return, close their queues first
+  ~Executor();
+
+  Executor(const Executor &) = delete;
+  Executor &operator=(const Executor &) = delete;
+
+  void spawn(Task task);
+
+  // Makes node runnable on the worker it was suspended on. Lock-free and
+  // never allocates, producers on the real-time path may call it.
+  static void schedule(ExecutorNode *node) noexcept;
+
+  // Worker of the calling thread, null outside the executor
+  static ExecutorWorker *current() noexcept;
+
+  size_t threads() const { return workers.size(); }
+
+private:
+  friend struct TaskFinal;
+  void task_done() noexcept;
+
+  std::vector<std::unique_ptr<ExecutorWorker>> workers;
+  std::atomic<size_t> next_worker = 0;
+  std::atomic<size_t> live_tasks = 0;
+};
+
+// Frees the frame of a finished task and lets ~Executor() know
+struct TaskFinal {
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(std::coroutine_handle<Task::promise_type> h) noexcept {
+    Executor *executor = h.promise().executor;
+    h.destroy();
+    executor->task_done();
+  }
+  void await_resume() const noexcept {}
+};
+
+inline auto Task::promise_type::final_suspend() noexcept { return TaskFinal{}; }
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Streams the arena is sized for when the static footprint profile is on,
+// sources beyond it are not captured
+#define FOOTPRINT_MAX_STREAMS 4
+
+// RSS of the sender before its first pipeline: the binary, libc,
+// libstdc++ and codec2's tables. Fixed so the budget does not move with
+// whatever the process happened to use when it was computed, footprint-check
+// fails if startup outgrows it.
+#define FOOTPRINT_BASELINE_BYTES (6 * 1024 * 1024)
+
+// Estimates for memory the sender does not allocate itself: the stack a
+// pipeline thread actually touches and the PipeWire client (context, core,
+// loops and its memory pool)
+#define FOOTPRINT_STACK_BYTES (256 * 1024)
+#define FOOTPRINT_PIPEWIRE_BYTES (8 * 1024 * 1024)
+// Small heap objects: names, metrics registry, iostream buffers
+#define FOOTPRINT_SLACK_BYTES (1024 * 1024)
+
+// Memory the sender may use with a given number of device pipelines, split
+// by subsystem
+struct FootprintBudget {
+  uint32_t streams;
+
+  // RSS of the process before any pipeline exists
+  size_t baseline;
+  // Queue slots, served from the arena
+  size_t pcm_queues;
+  size_t codec2_queues;
+  size_t codec2_pools;
+  size_t capture_record;
+  // Codec2 states live on the codec2 heap, measured per mode at startup
+  size_t codec2_states;
+  size_t stacks;
+  size_t pipewire;
+  size_t slack;
+
+  size_t arena() const {
+    return pcm_queues + codec2_queues + codec2_pools + capture_record;
+  }
+
+  size_t total() const {
+    return baseline + arena() + codec2_states + stacks + pipewire + slack;
+  }
+};
+
+FootprintBudget footprint_budget(uint32_t streams);
+
+// Prints the budget, the arena usage and the RSS so far
+void footprint_report(const FootprintBudget &budget);
+
+size_t footprint_rss();
+size_t footprint_peak_rss();
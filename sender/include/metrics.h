@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+
+#define METRICS_SOCKET_PATH "/tmp/sbc-codec2-sender.sock"
+// Set non zero to also serve metrics on 127.0.0.1:<port>
+#define METRICS_TCP_PORT 0
+
+#define METRICS_STAGES_MAX 64
+// Latency buckets are powers of two in microseconds, 1us .. ~1s, plus +Inf
+#define METRICS_BUCKETS 22
+
+enum class Counter : uint32_t {
+  FramesCaptured,
+  FramesEncoded,
+  FramesDropped,
+  FramesSid,
+  FramesSuppressed,
+  DeadlineMisses,
+  PwXruns,
+  Sessions,
+  Reconnects,
+  Count,
+};
+
+enum class Gauge : uint32_t {
+  Codec2Mode,
+  Count,
+};
+
+enum class Histogram : uint32_t {
+  CaptureCallback,
+  QueueWait,
+  Encode,
+  Reconnect,  // source lost until its audio flows again
+  FirstFrame, // capture of a session's first frame until it is encoded
+  WakeupJitter, // lateness against the frame period, see JitterMeter
+  CaptureLatency, // capture device to process callback, from PipeWire
+  Count,
+};
+
+// Counters of one pipeline stage. Only the owning thread writes to it, so
+// updates are plain relaxed load/store pairs and the scraper never contends
+// with the writer. Each stage sits on its own cache lines.
+class alignas(64) StageMetrics {
+public:
+  void add(Counter c, uint64_t n = 1) {
+    auto &v = counters[static_cast<uint32_t>(c)];
+    v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+
+  void set(Gauge g, int64_t value) {
+    gauges[static_cast<uint32_t>(g)].store(value, std::memory_order_relaxed);
+  }
+
+  void observe(Histogram h, uint64_t ns);
+
+private:
+  friend class MetricsServer;
+  friend StageMetrics *metrics_stage(const char *name, const void *owner);
+  friend void metrics_unregister(const void *owner);
+
+  // nullptr while the slot is free
+  const char *name = nullptr;
+  const void *owner = nullptr;
+
+  std::atomic<uint64_t> counters[static_cast<uint32_t>(Counter::Count)] = {};
+  std::atomic<int64_t> gauges[static_cast<uint32_t>(Gauge::Count)] = {};
+  std::atomic<uint64_t> buckets[static_cast<uint32_t>(Histogram::Count)]
+                               [METRICS_BUCKETS] = {};
+  std::atomic<uint64_t> sums_ns[static_cast<uint32_t>(Histogram::Count)] = {};
+};
+
+// Claims the metrics slot of a stage, call once per writer thread outside
+// the real-time path. name must outlive the registration, owner is what
+// metrics_unregister() releases it by.
+StageMetrics *metrics_stage(const char *name, const void *owner = nullptr);
+
+// Registers a gauge sampled at scrape time, fn must not block. labels is
+// either empty or a Prometheus label set such as {device="x"}.
+void metrics_gauge(const std::string &name, const std::string &labels,
+                   std::function<int64_t()> fn, const void *owner = nullptr);
+
+// Drops the gauges and frees the stage slots registered by owner. Their
+// writers must be done, the next scrape no longer shows them.
+void metrics_unregister(const void *owner);
+
+uint64_t metrics_now_ns();
+
+// Serves the Prometheus text format over a Unix socket and optionally a
+// localhost TCP port, from its own thread. POST /reload reloads the config.
+class MetricsServer {
+public:
+  MetricsServer(const std::string &socket_path, uint16_t tcp_port);
+  ~MetricsServer();
+
+  static std::string render();
+
+private:
+  void serve();
+
+  std::string socket_path;
+  int unix_fd = -1;
+  int tcp_fd = -1;
+  int wake_fd[2] = {-1, -1};
+  std::thread worker;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "data.h"
+
+// Wire format of one Codec2Data frame between senders, the relay and its
+// subscribers. All fields are big endian, the payload follows the header.
+//
+//   0  'S' 'C'      magic
+//   2  version
+//   3  FrameType
+//   4  Codec2 mode, 0 for SID frames
+//   5  payload bytes
+//   6  reserved, 0
+//   8  sender id    unique per sender process
+//  12  stream id    capture device within the sender
+//  16  session id
+//  20  piece id
+//  24  sent_ns      sender's CLOCK_MONOTONIC, only comparable on one host
+//  32  payload
+#define PACKET_VERSION 1
+#define PACKET_HEADER_SIZE 32
+#define PACKET_SIZE_MAX (PACKET_HEADER_SIZE + CODEC2_FRAME_MAX)
+
+// Offsets the relay's shard selector reads, see relay.cc
+#define PACKET_SENDER_ID_OFFSET 8
+#define PACKET_STREAM_ID_OFFSET 12
+
+struct Packet {
+  uint32_t sender_id;
+  uint64_t sent_ns;
+  Codec2Data data;
+};
+
+// Serializes into buf, which holds at least PACKET_SIZE_MAX bytes, and
+// returns the packet size
+size_t packet_encode(const Packet &packet, uint8_t *buf);
+
+// Parses a received datagram, false if it is not a valid packet
+bool packet_decode(const uint8_t *buf, size_t size, Packet &packet);
+
+// CLOCK_MONOTONIC in nanoseconds, as used for sent_ns
+uint64_t packet_now_ns();
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+
+#include "MsgQueue.h"
+#include "data.h"
+#include "metrics.h"
+#include "thread_profile.h"
+
+class WavFile;
+
+// Silence of this many samples (1 s) ends a session, default of
+// session_silence_samples in config.h
+#define SESSION_SILENCE_SAMPLES 8000
+
+// Cuts captured audio into PcmData frames and numbers them by session and
+// piece. Runs on the capture thread, must not block or allocate.
+class PcmFramer {
+public:
+  PcmFramer(uint32_t stream_id, MsgQueue<PcmData> *pcm_queue,
+            StageMetrics *metrics);
+
+  // Feeds one chunk of mono S16 samples as delivered by the capture source
+  void process(const int16_t *samples, uint32_t n_samples);
+
+  // Every emitted frame is also written here, debug only, blocks on I/O
+  void set_debug_tap(WavFile *wav_file) { this->debug_wav = wav_file; }
+
+  StageMetrics *stage_metrics() const { return this->metrics; }
+
+  // Call once capture stopped
+  void report() const { this->jitter.report("capture"); }
+
+  // Ends the current session after the source went away. Only call while
+  // no capture thread is feeding the framer.
+  void interrupt();
+
+private:
+  void reset_session();
+
+  void send_data(const int16_t *samples, uint32_t n_samples);
+
+  void emit_pcm_data();
+
+  MsgQueue<PcmData> *pcm_queue;
+  StageMetrics *metrics;
+  WavFile *debug_wav = nullptr;
+
+  // Callback wakeups against the samples delivered so far
+  JitterMeter jitter{metrics};
+  uint64_t samples_seen = 0;
+
+  PcmData pcm_data = {0};
+
+  uint64_t zero_samples = 0;
+
+  bool new_session = true;
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <semaphore>
+#include <string>
+#include <thread>
+
+#include "MsgQueue.h"
+#include "config.h"
+#include "data.h"
+#include "executor.h"
+#include "pcm_framer.h"
+
+#define DECODER_DEBUGGER 1
+
+// Defaults of pcm_queue_size and codec2_queue_size in config.h
+#define PCM_QUEUE_SIZE 64
+#define CODEC2_QUEUE_SIZE 64
+
+// Everything downstream of one capture device: its framer, queues, encoder
+// thread and the optional decoder debugger, a coroutine on the executor
+// all pipelines share
+class DevicePipeline {
+public:
+  DevicePipeline(uint32_t stream_id, const std::string &name);
+
+  ~DevicePipeline();
+
+  // Closes the pipeline and waits for its threads to drain it
+  void close();
+
+  // Capture side entry point, only one capture thread may use it at a time
+  PcmFramer *framer() { return &framer_; }
+
+  const std::string &name() const { return name_; }
+
+  uint32_t id() const { return stream_id; }
+
+  // Either queue is more than half full
+  bool backlogged() const {
+    return pcm_queue.size() > pcm_queue.capacity() / 2 ||
+           codec2_queue.size() > codec2_queue.capacity() / 2;
+  }
+
+private:
+#ifdef DECODER_DEBUGGER
+  Task decoder_debugger();
+#endif
+
+  uint32_t stream_id;
+  std::string name_;
+  // Kept alive for the metrics registry, which stores the pointers until
+  // the destructor unregisters them
+  std::string capture_stage;
+  std::string encoder_stage;
+  std::string decoder_stage;
+
+  MsgQueue<PcmData> pcm_queue{config_current()->pcm_queue_size};
+  MsgQueue<Codec2Data> codec2_queue{config_current()->codec2_queue_size};
+
+  PcmFramer framer_;
+
+  std::thread encoder_worker;
+#ifdef DECODER_DEBUGGER
+  std::binary_semaphore decoder_done{0};
+#endif
+};
@@ -1,17 +1,42 @@
 #pragma once
 
+#include <functional>
+#include <memory>
+#include <string>
+
 #include "MsgQueue.h"
 #include "data.h"
+#include "pcm_framer.h"
+
+// Defaults of capture_match and capture_device_api in config.h
+
+// Substring of device.description (or node.description) a source must
+// contain to be captured, empty matches every source
+#define CAPTURE_MATCH ""
+// Only capture sources of this device.api, empty accepts any
+#define CAPTURE_DEVICE_API "bluez5"
+
+// A device whose sources stay away this long is closed
+#define DEVICE_EXPIRY_MS (10 * 60 * 1000)
 
 class PwStreamImpl;
 
 class PwStream {
 public:
-  explicit PwStream(MsgQueue<PcmData> *pcm_queue);
+  // Called on the PipeWire thread for every matching source node, returns
+  // the framer its audio is fed to
+  using OpenDevice =
+      std::function<PcmFramer *(uint32_t stream_id, const std::string &name)>;
+  // Called on the PipeWire thread once a device has had no source for
+  // DEVICE_EXPIRY_MS, its framer is no longer fed. Without it devices are
+  // kept until exit.
+  using CloseDevice = std::function<void(uint32_t stream_id)>;
+
+  explicit PwStream(OpenDevice open_device, CloseDevice close_device = {});
   ~PwStream();
 
   void run();
 
 private:
   std::unique_ptr<PwStreamImpl> impl_;
-};
\ No newline at end of file
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <netinet/in.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define RELAY_PORT 7300
+// Datagrams taken from and handed to the kernel per system call
+#define RELAY_BATCH 64
+// 0 runs one shard per online CPU
+#define RELAY_SHARDS 0
+// At most one bit each in a stream's route mask
+#define RELAY_SUBSCRIBERS_MAX 16
+// How often a blocked shard checks for shutdown
+#define RELAY_POLL_MS 100
+// A stream that sent nothing for this long is forgotten, its next packet
+// starts it anew
+#define RELAY_STREAM_IDLE_MS (60 * 1000)
+// Matches any sender, stream or session id in a subscription
+#define RELAY_ANY UINT32_MAX
+
+// Where to forward to and which packets, by the ids streams are demuxed on
+struct RelaySubscriber {
+  sockaddr_in address{};
+  uint32_t sender_id = RELAY_ANY;
+  uint32_t stream_id = RELAY_ANY;
+  uint32_t session_id = RELAY_ANY;
+};
+
+struct RelayConfig {
+  uint16_t port = RELAY_PORT;
+  uint32_t shards = RELAY_SHARDS;
+  // Each packet is forwarded to those whose ids match it
+  std::vector<RelaySubscriber> subscribers;
+  // Each shard appends what it receives to <prefix>-<shard>.bin, empty for
+  // no archive
+  std::string archive_prefix;
+};
+
+// Totals over all shards since start
+struct RelayStats {
+  uint64_t packets_in = 0;
+  uint64_t packets_out = 0;
+  uint64_t malformed = 0;
+  uint64_t streams = 0; // stream starts, again after an eviction
+  uint64_t evicted = 0; // streams forgotten after RELAY_STREAM_IDLE_MS
+  uint64_t sessions = 0;
+  uint64_t gaps = 0; // pieces missing within a session
+  uint64_t unrouted = 0; // packets no subscriber matched
+  uint64_t latency_ns = 0; // receive to forward, summed over packets
+  uint64_t latency_max_ns = 0;
+};
+
+class RelayShard;
+
+// Receives packets of many senders on one UDP port and forwards them. Each
+// shard is a thread with its own SO_REUSEPORT socket, the kernel hands it
+// every packet of the streams hashed to it, so per-stream state is never
+// shared between threads.
+class Relay {
+public:
+  explicit Relay(const RelayConfig &config);
+  ~Relay();
+
+  RelayStats stats() const;
+
+  uint32_t shards() const { return shards_.size(); }
+
+private:
+  std::vector<std::unique_ptr<RelayShard>> shards_;
+};
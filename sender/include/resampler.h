@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Input samples handled per pass, process() takes any count
+#define RESAMPLER_CHUNK 512
+
+// Rational polyphase FIR resampler for mono S16, e.g. the 44.1 or 48 kHz of
+// Bluetooth audio down to the 8 kHz Codec2 wants. The low-pass passes
+// 0.425 * out_rate (3.4 kHz at 8 kHz) and stops at half of it. Filter and
+// buffers are set up in the constructor, process() never allocates.
+class Resampler {
+public:
+  Resampler(uint32_t in_rate, uint32_t out_rate);
+
+  // Consumes all n input samples, writes at most out_max output samples and
+  // returns how many. n * out_rate / in_rate + 1 is always enough.
+  size_t process(const int16_t *in, size_t n, int16_t *out, size_t out_max);
+
+  uint32_t in_rate() const { return in_rate_; }
+
+  // Group delay of the filter
+  double delay_ms() const;
+
+private:
+  uint32_t in_rate_;
+  uint32_t up;   // interpolation factor L
+  uint32_t down; // decimation factor M
+  uint32_t taps; // per phase, in input samples
+
+  // Phase p holds taps coefficients, newest input first
+  std::vector<float> coefs;
+  // taps - 1 samples of history followed by the current chunk
+  std::vector<float> buf;
+
+  uint32_t phase = 0;
+  size_t pos; // newest input sample of the next output, in buf
+};
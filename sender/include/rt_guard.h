@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+
+// Allocation and blocking call checks for real-time code. Binaries linked
+// with rt_guard.cc interpose malloc/free and the usual blocking libc calls
+// and count every call made by a thread while it is inside an RtSection.
+
+struct RtViolations {
+  uint64_t allocations;
+  uint64_t blocking_calls;
+  const char *first; // first offending call, nullptr if none
+};
+
+// Marks the calling thread as running real-time code while alive
+class RtSection {
+public:
+  RtSection();
+  ~RtSection();
+
+  RtSection(const RtSection &) = delete;
+  RtSection &operator=(const RtSection &) = delete;
+};
+
+// Violations recorded on the calling thread so far
+RtViolations rt_violations();
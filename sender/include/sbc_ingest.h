@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include <sbc/sbc.h>
+
+#include "pcm_framer.h"
+#include "resampler.h"
+
+// Largest SBC frame: 8 subbands, 16 blocks, joint stereo at bitpool 250
+#define SBC_INGEST_FRAME_MAX 1024
+// Largest decoded frame: 16 blocks of 8 subbands, 2 channels
+#define SBC_INGEST_SAMPLES_MAX 256
+
+// Decodes SBC straight into a PcmFramer, without PipeWire in between:
+// libsbc decodes each frame, the channels are mixed down and a polyphase
+// resampler takes them to 8 kHz. Only a change of SBC sample rate
+// allocates, the steady state never does.
+class SbcIngest {
+public:
+  explicit SbcIngest(PcmFramer *framer);
+  ~SbcIngest();
+
+  SbcIngest(const SbcIngest &) = delete;
+  SbcIngest &operator=(const SbcIngest &) = delete;
+
+  // A stream of SBC frames as in a .sbc file, split anywhere
+  void feed_frames(const uint8_t *data, size_t n);
+
+  // One A2DP media packet as read from a BlueZ transport: RTP header, the
+  // SBC payload header and whole frames. False if it cannot be used.
+  bool feed_rtp(const uint8_t *packet, size_t n);
+
+  // 8 kHz samples handed to the framer so far
+  uint64_t samples_out() const { return samples_out_; }
+
+  // Filter delay the ingest adds, 0 before the first frame
+  double delay_ms() const { return resampler ? resampler->delay_ms() : 0; }
+
+  void report() const;
+
+private:
+  // Decodes the whole frames at the start of data, returns the bytes used
+  size_t decode(const uint8_t *data, size_t n);
+
+  PcmFramer *framer;
+  sbc_t sbc;
+  std::unique_ptr<Resampler> resampler;
+
+  // Start of a frame split across feed_frames() calls
+  uint8_t carry[2 * SBC_INGEST_FRAME_MAX];
+  size_t carry_n = 0;
+
+  uint64_t samples_out_ = 0;
+  uint64_t frames = 0;
+  uint64_t errors = 0;
+  uint64_t packets_dropped = 0;
+  uint64_t decode_ns = 0;
+  uint64_t resample_ns = 0;
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+
+#include "metrics.h"
+
+// Defaults of the thread_* settings in config.h, the placement of every
+// pipeline thread. Priority 1..99 asks for SCHED_FIFO, 0 keeps the default
+// time sharing policy. CPU -1 leaves the thread free to run anywhere.
+#define THREAD_PROFILE_CAPTURE_PRIORITY 0 // PipeWire's data loop, see below
+#define THREAD_PROFILE_CAPTURE_CPU -1
+#define THREAD_PROFILE_ENCODER_PRIORITY 60
+#define THREAD_PROFILE_ENCODER_CPU -1
+#define THREAD_PROFILE_DECODER_PRIORITY 0
+#define THREAD_PROFILE_DECODER_CPU -1
+#define THREAD_PROFILE_POOL_PRIORITY 0
+#define THREAD_PROFILE_POOL_CPU -1
+
+// 1 locks all current and future pages, touched pages only where
+// supported
+#define THREAD_PROFILE_MLOCKALL 1
+
+enum class ThreadStage : uint32_t {
+  // The capture stream callbacks run on PipeWire's data loop, which
+  // PipeWire may already have made real-time. Priority 0 leaves it alone.
+  Capture,
+  Encoder,
+  Decoder,
+  PoolRefill,
+  Count,
+};
+
+// Applies the configured placement of a stage to the calling thread.
+// Missing RT privileges or a CPU that does not exist are reported once per
+// stage and the thread carries on with what it has. Makes syscalls, call it
+// when the thread starts, never from a real-time callback.
+void thread_profile_apply(ThreadStage stage);
+
+// mlockall() when thread_mlockall is set, reported and skipped without the
+// privilege
+void thread_profile_lock_memory();
+
+// How late a stage wakes up against the timeline of the media it handles.
+// Each wakeup is compared with the first one plus the media time elapsed
+// since, the earliest wakeup seen is the reference. A drift away from the
+// 40 ms frame period shows up as a growing lateness.
+class JitterMeter {
+public:
+  explicit JitterMeter(StageMetrics *metrics) : metrics(metrics) {}
+
+  // media_ns is the position of the data on its timeline, restart begins a
+  // new one. Never blocks or allocates.
+  void wake(uint64_t media_ns, bool restart);
+
+  void report(const char *stage) const;
+
+private:
+  StageMetrics *metrics;
+
+  bool started = false;
+  uint64_t anchor_ns = 0;
+
+  uint64_t wakeups = 0;
+  uint64_t sum_ns = 0;
+  uint64_t max_ns = 0;
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+// Pipeline tracing, enabled with -DSENDER_TRACE=ON. Without PIPELINE_TRACE
+// the macros below expand to nothing.
+
+#define TRACE_OUTPUT "pipeline-trace.json"
+
+#ifdef PIPELINE_TRACE
+
+#include <cstdint>
+#include <string>
+
+// Events kept per thread, older ones are overwritten
+#define TRACE_EVENTS_PER_THREAD 8192
+// Rings are handed back when their thread exits, threads beyond this many
+// at once are not traced and trace_dump() warns about them
+#define TRACE_THREADS_MAX 16
+
+// Records a begin ('B') or end ('E') event in the calling thread's ring.
+// name must be a string literal. Never allocates or locks.
+void trace_event(const char *name, char phase);
+
+// Writes every thread's ring as Chrome trace JSON (chrome://tracing, Perfetto)
+void trace_dump(const std::string &path);
+
+class TraceScope {
+public:
+  explicit TraceScope(const char *name) : name(name) { trace_event(name, 'B'); }
+  ~TraceScope() { trace_event(name, 'E'); }
+
+private:
+  const char *name;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_BEGIN(name) trace_event(name, 'B')
+#define TRACE_END(name) trace_event(name, 'E')
+#define TRACE_DUMP(path) trace_dump(path)
+
+#else
+
+#define TRACE_SCOPE(name)
+#define TRACE_BEGIN(name)
+#define TRACE_END(name)
+#define TRACE_DUMP(path)
+
+#endif
@@ -3,10 +3,25 @@
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <vector>
 
 #include "data.h"
 
-struct WavHeader;
+struct WavHeader {
+  char riff[4] = {'R', 'I', 'F', 'F'};
+  uint32_t chunk_size = 0; // placeholder
+  char wave[4] = {'W', 'A', 'V', 'E'};
+  char fmt[4] = {'f', 'm', 't', ' '};
+  uint32_t subchunk1_size = 16;
+  uint16_t audio_format = 1; // PCM
+  uint16_t num_channels = 1;
+  uint32_t sample_rate = 8000;
+  uint32_t byte_rate = 0;   // placeholder
+  uint16_t block_align = 0; // placeholder
+  uint16_t bits_per_sample = 16;
+  char data[4] = {'d', 'a', 't', 'a'};
+  uint32_t subchunk2_size = 0; // placeholder
+};
 
 class WavFile {
 public:
@@ -18,7 +33,12 @@ public:
 private:
   std::ofstream fs;
 
-  WavHeader *header;
+  // Kept inline, a recording never allocates for its header
+  WavHeader header;
 
   size_t n_samples;
-};
\ No newline at end of file
+};
+
+// Reads a whole 8 kHz mono S16 WAV file, throws std::runtime_error on
+// anything else
+std::vector<int16_t> read_wav(const std::string &filename);
\ No newline at end of file
@@ -0,0 +1,119 @@
+#include "arena.h"
+#include "footprint.h"
+
+#include <sys/mman.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+
+static std::once_flag arena_once;
+static char *arena_base = nullptr;
+static size_t arena_size = 0;
+static bool arena_mlocked = false;
+static std::atomic<size_t> arena_offset = 0;
+
+// Blocks given back, by exact size. A handful of queues per device, a
+// block that does not fit is leaked as before.
+#define ARENA_FREE_MAX 64
+
+struct FreeBlock {
+  char *p;
+  size_t size;
+};
+
+static std::mutex free_mutex;
+static FreeBlock free_blocks[ARENA_FREE_MAX];
+static size_t free_n = 0;
+
+static size_t block_size(size_t bytes, size_t &alignment) {
+  // Every allocation starts on its own cache line
+  if (alignment < ARENA_CACHE_LINE)
+    alignment = ARENA_CACHE_LINE;
+  return (bytes + alignment - 1) & ~(alignment - 1);
+}
+
+static void arena_reserve(size_t bytes) {
+  bytes = (bytes + 4095) & ~size_t(4095);
+
+  // Prefaulted so queue memory never takes a page fault on the RT path
+  void *base = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+  if (base == MAP_FAILED)
+    throw std::runtime_error("Failed to reserve the memory arena");
+
+  // Locking needs CAP_IPC_LOCK or a large enough RLIMIT_MEMLOCK, run unlocked
+  // rather than not at all
+  if (mlock(base, bytes) == 0)
+    arena_mlocked = true;
+  else
+    std::cerr << "arena: cannot lock " << bytes << " bytes: "
+              << strerror(errno) << std::endl;
+
+  arena_base = static_cast<char *>(base);
+  arena_size = bytes;
+}
+
+void arena_init(size_t bytes) {
+  bool reserved = false;
+  std::call_once(arena_once, [&] {
+    arena_reserve(bytes);
+    reserved = true;
+  });
+
+  if (!reserved)
+    std::cerr << "arena: already reserved, ignoring a new size of " << bytes
+              << " bytes" << std::endl;
+}
+
+void *arena_allocate(size_t bytes, size_t alignment) {
+  std::call_once(arena_once, [] {
+    arena_reserve(footprint_budget(FOOTPRINT_MAX_STREAMS).arena());
+  });
+
+  size_t size = block_size(bytes, alignment);
+
+  {
+    std::lock_guard<std::mutex> lock(free_mutex);
+    for (size_t i = 0; i < free_n; ++i) {
+      FreeBlock block = free_blocks[i];
+      if (block.size == size &&
+          reinterpret_cast<uintptr_t>(block.p) % alignment == 0) {
+        free_blocks[i] = free_blocks[--free_n];
+        return block.p;
+      }
+    }
+  }
+
+  size_t offset = arena_offset.load(std::memory_order_relaxed);
+  size_t start;
+  do {
+    start = (offset + alignment - 1) & ~(alignment - 1);
+    if (start + size > arena_size) {
+      std::cerr << "arena: out of memory allocating " << bytes << " bytes, "
+                << offset << " of " << arena_size << " used" << std::endl;
+      throw std::bad_alloc();
+    }
+  } while (!arena_offset.compare_exchange_weak(offset, start + size,
+                                               std::memory_order_relaxed));
+
+  return arena_base + start;
+}
+
+void arena_deallocate(void *p, size_t bytes, size_t alignment) {
+  size_t size = block_size(bytes, alignment);
+
+  std::lock_guard<std::mutex> lock(free_mutex);
+  if (free_n < ARENA_FREE_MAX)
+    free_blocks[free_n++] = {static_cast<char *>(p), size};
+}
+
+size_t arena_capacity() { return arena_size; }
+
+size_t arena_used() { return arena_offset.load(std::memory_order_relaxed); }
+
+bool arena_locked() { return arena_mlocked; }
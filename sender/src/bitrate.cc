@@ -0,0 +1,82 @@
+#include "bitrate.h"
+
+#include <cassert>
+#include <iostream>
+
+static double fill(size_t depth, size_t capacity) {
+  return capacity ? static_cast<double>(depth) / capacity : 0.0;
+}
+
+BitrateController::BitrateController(int initial_mode)
+    : idx(codec2_mode_index(initial_mode)) {
+  assert(idx >= 0);
+}
+
+int BitrateController::update(const BitrateSample &sample,
+                              const Config &config) {
+  ++this->frames[this->idx];
+
+  double pcm_fill = fill(sample.pcm_depth, sample.pcm_capacity);
+  double out_fill = fill(sample.out_depth, sample.out_capacity);
+  double encode_ratio =
+      static_cast<double>(sample.encode_ns) / FRAME_PERIOD_NS;
+
+  bool deadline_miss = sample.encode_ns > FRAME_PERIOD_NS;
+  if (deadline_miss)
+    ++this->deadline_misses;
+
+  bool pressure = pcm_fill > config.bitrate_high_water ||
+                  out_fill > config.bitrate_high_water ||
+                  encode_ratio > config.bitrate_encode_high;
+  bool is_calm = pcm_fill < config.bitrate_low_water &&
+                 out_fill < config.bitrate_low_water &&
+                 encode_ratio < config.bitrate_encode_low;
+
+  if (pressure) {
+    ++this->pressured;
+    this->calm = 0;
+  } else if (is_calm) {
+    ++this->calm;
+    this->pressured = 0;
+  } else {
+    this->pressured = 0;
+    this->calm = 0;
+  }
+
+  int next = this->idx;
+  // Validated by the config parser
+  int ceiling = codec2_mode_index(config.codec2_mode);
+
+  // A dropped frame or a missed deadline already hurts, step down at once
+  if (sample.dropped || deadline_miss ||
+      this->pressured >= config.bitrate_down_frames) {
+    if (next + 1 < CODEC2_MODES_N)
+      ++next;
+  } else if (this->calm >= config.bitrate_up_frames) {
+    if (next > ceiling)
+      --next;
+  }
+
+  // A reload lowered the ceiling
+  if (next < ceiling)
+    next = ceiling;
+
+  // No logging here, this runs in the encoder loop. Switches are visible
+  // through the codec2_mode metric and report().
+  if (next != this->idx) {
+    this->idx = next;
+    this->pressured = 0;
+    this->calm = 0;
+    ++this->switches;
+  }
+
+  return this->mode();
+}
+
+void BitrateController::report() const {
+  std::cout << "bitrate: switches=" << switches
+            << " deadline_misses=" << deadline_misses << " frames per mode:";
+  for (int i = 0; i < CODEC2_MODES_N; ++i)
+    std::cout << " " << CODEC2_MODES[i] << "=" << frames[i];
+  std::cout << std::endl;
+}
@@ -0,0 +1,84 @@
+#include "capture_trace.h"
+#include "arena.h"
+
+#include <iostream>
+#include <stdexcept>
+
+CaptureRecorder::CaptureRecorder(const std::string &path)
+    : fs(path, std::ios::binary) {
+  if (!fs)
+    throw std::runtime_error("Failed to open capture trace " + path);
+
+  CaptureTraceHeader header;
+  fs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+  writer = std::thread([this] { write(); });
+
+  std::cout << "Recording capture callbacks to " << path << std::endl;
+}
+
+CaptureRecorder::~CaptureRecorder() {
+  chunks.close();
+  writer.join();
+  fs.close();
+
+  std::cout << "capture record: " << recorded << " callbacks, " << dropped
+            << " dropped" << std::endl;
+}
+
+void CaptureRecorder::record(uint32_t stream_id, uint64_t timestamp_ns,
+                             const int16_t *samples, uint32_t n_samples) {
+  if (n_samples > CAPTURE_RECORD_SAMPLES_MAX ||
+      !chunks.emplace(stream_id, timestamp_ns, samples, n_samples)) {
+    ++dropped;
+    return;
+  }
+
+  ++recorded;
+}
+
+size_t CaptureRecorder::arena_bytes() {
+  return arena_queue_bytes<Chunk>(CAPTURE_RECORD_QUEUE_SIZE);
+}
+
+void CaptureRecorder::write() {
+  while (auto maybe_chunk = chunks.recv()) {
+    const Chunk &chunk = *maybe_chunk;
+
+    fs.write(reinterpret_cast<const char *>(&chunk.record),
+             sizeof(chunk.record));
+    fs.write(reinterpret_cast<const char *>(chunk.samples),
+             chunk.record.n_samples * sizeof(int16_t));
+  }
+}
+
+CaptureReplay::CaptureReplay(const std::string &path)
+    : fs(path, std::ios::binary) {
+  CaptureTraceHeader expected;
+  CaptureTraceHeader header;
+
+  if (!fs.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0)
+    throw std::runtime_error(path + " is not a capture trace");
+
+  if (header.version != expected.version ||
+      header.sample_rate != expected.sample_rate)
+    throw std::runtime_error(path + " has an unsupported trace version");
+}
+
+bool CaptureReplay::next(CaptureTraceRecord &record,
+                         std::vector<int16_t> &samples) {
+  if (!fs.read(reinterpret_cast<char *>(&record), sizeof(record)))
+    return false;
+
+  if (record.n_samples > CAPTURE_RECORD_SAMPLES_MAX) {
+    std::cerr << "capture replay: corrupt record of " << record.n_samples
+              << " samples" << std::endl;
+    return false;
+  }
+
+  samples.resize(record.n_samples);
+  return static_cast<bool>(
+      fs.read(reinterpret_cast<char *>(samples.data()),
+              record.n_samples * sizeof(int16_t)));
+}
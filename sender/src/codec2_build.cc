@@ -0,0 +1,27 @@
+#include "codec2_build.h"
+
+#include <stdexcept>
+#include <string>
+
+const char *codec2_build_name() {
+#if defined(CODEC2_ISA)
+  return "optimized for " CODEC2_ISA;
+#elif defined(CODEC2_OPTIMIZED)
+  return "optimized";
+#else
+  return "stock";
+#endif
+}
+
+void codec2_build_check() {
+  // Other architectures have no __builtin_cpu_supports in the compilers we
+  // build with, the ISA is trusted there
+#if defined(CODEC2_ISA) && (defined(__x86_64__) || defined(__i386__))
+  __builtin_cpu_init();
+  if (!__builtin_cpu_supports(CODEC2_ISA))
+    throw std::runtime_error(std::string("codec2 was built for ") +
+                             CODEC2_ISA +
+                             ", which this CPU does not support. Rebuild "
+                             "with a lower SENDER_CODEC2_ISA.");
+#endif
+}
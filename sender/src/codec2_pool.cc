@@ -0,0 +1,111 @@
+#include "codec2_pool.h"
+#include "thread_profile.h"
+
+#include <malloc.h>
+
+#include <chrono>
+#include <cstring>
+
+Codec2Pool::Codec2Pool() {
+  for (int i = 0; i < CODEC2_MODES_N; ++i) {
+    ready[i] = std::make_unique<
+        rigtorp::SPSCQueue<CODEC2 *, QueueAllocator<CODEC2 *>>>(
+        CODEC2_POOL_SIZE);
+    for (int n = 0; n < CODEC2_POOL_SIZE; ++n)
+      ready[i]->push(create_warm(i));
+  }
+
+  refiller = std::thread([this] { refill(); });
+}
+
+Codec2Pool::~Codec2Pool() {
+  stopping = true;
+  wake.release();
+  refiller.join();
+
+  while (CODEC2 **codec2 = used.front()) {
+    codec2_destroy(*codec2);
+    used.pop();
+  }
+
+  for (int i = 0; i < CODEC2_MODES_N; ++i) {
+    while (CODEC2 **codec2 = ready[i]->front()) {
+      codec2_destroy(*codec2);
+      ready[i]->pop();
+    }
+  }
+}
+
+// Runs one frame through the codec so its tables and buffers are touched
+// before the first real frame
+CODEC2 *Codec2Pool::create_warm(int idx) {
+  CODEC2 *codec2 = codec2_create(CODEC2_MODES[idx]);
+
+  short samples[PCM_SAMPLE_MAX];
+  unsigned char bytes[CODEC2_FRAME_MAX];
+  memset(samples, 0, sizeof(samples));
+
+  codec2_encode(codec2, bytes, samples);
+  codec2_decode(codec2, samples, bytes);
+
+  return codec2;
+}
+
+size_t Codec2Pool::arena_bytes() {
+  return CODEC2_MODES_N * arena_queue_bytes<CODEC2 *>(CODEC2_POOL_SIZE) +
+         arena_queue_bytes<CODEC2 *>(CODEC2_POOL_USED_QUEUE_SIZE);
+}
+
+size_t Codec2Pool::state_bytes(int idx) {
+  size_t before = mallinfo2().uordblks;
+  CODEC2 *codec2 = create_warm(idx);
+  size_t after = mallinfo2().uordblks;
+  codec2_destroy(codec2);
+
+  return after > before ? after - before : 0;
+}
+
+CODEC2 *Codec2Pool::acquire(int idx) {
+  if (CODEC2 **codec2 = ready[idx]->front()) {
+    CODEC2 *result = *codec2;
+    ready[idx]->pop();
+    if (ready[idx]->empty())
+      wake.release();
+    return result;
+  }
+
+  ++misses_;
+  wake.release();
+  return create_warm(idx);
+}
+
+void Codec2Pool::release(CODEC2 *codec2) {
+  if (!used.try_push(codec2))
+    codec2_destroy(codec2);
+}
+
+void Codec2Pool::refill() {
+  thread_profile_apply(ThreadStage::PoolRefill);
+
+  while (!stopping) {
+    while (CODEC2 **codec2 = used.front()) {
+      codec2_destroy(*codec2);
+      used.pop();
+    }
+
+    // Topped up rather than one for one, so the states the encoder took at
+    // startup are replaced too
+    for (int i = 0; i < CODEC2_MODES_N; ++i) {
+      while (ready[i]->size() < CODEC2_POOL_SIZE) {
+        CODEC2 *fresh = create_warm(i);
+        if (!ready[i]->try_push(fresh)) {
+          codec2_destroy(fresh);
+          break;
+        }
+      }
+    }
+
+    (void)wake.try_acquire_for(
+        std::chrono::milliseconds(CODEC2_POOL_REFILL_MS));
+  }
+}
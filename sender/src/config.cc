@@ -0,0 +1,317 @@
+#include "config.h"
+#include "bitrate.h"
+#include "data.h"
+#include "dtx.h"
+#include "pcm_framer.h"
+#include "pipeline.h"
+#include "pw-stream.h"
+#include "thread_profile.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+Config config_defaults() {
+  Config config;
+
+  config.codec2_mode = CODEC2_MODE;
+  config.session_silence_samples = SESSION_SILENCE_SAMPLES;
+  config.pcm_queue_size = PCM_QUEUE_SIZE;
+  config.codec2_queue_size = CODEC2_QUEUE_SIZE;
+
+  config.dtx_silence_dbfs = DTX_SILENCE_DBFS;
+  config.dtx_hangover_frames = DTX_HANGOVER_FRAMES;
+  config.dtx_sid_interval = DTX_SID_INTERVAL;
+
+  config.bitrate_high_water = BITRATE_HIGH_WATER;
+  config.bitrate_low_water = BITRATE_LOW_WATER;
+  config.bitrate_encode_high = BITRATE_ENCODE_HIGH;
+  config.bitrate_encode_low = BITRATE_ENCODE_LOW;
+  config.bitrate_down_frames = BITRATE_DOWN_FRAMES;
+  config.bitrate_up_frames = BITRATE_UP_FRAMES;
+
+  config.capture_match = CAPTURE_MATCH;
+  config.capture_device_api = CAPTURE_DEVICE_API;
+
+  config.thread_capture_priority = THREAD_PROFILE_CAPTURE_PRIORITY;
+  config.thread_capture_cpu = THREAD_PROFILE_CAPTURE_CPU;
+  config.thread_encoder_priority = THREAD_PROFILE_ENCODER_PRIORITY;
+  config.thread_encoder_cpu = THREAD_PROFILE_ENCODER_CPU;
+  config.thread_decoder_priority = THREAD_PROFILE_DECODER_PRIORITY;
+  config.thread_decoder_cpu = THREAD_PROFILE_DECODER_CPU;
+  config.thread_pool_priority = THREAD_PROFILE_POOL_PRIORITY;
+  config.thread_pool_cpu = THREAD_PROFILE_POOL_CPU;
+  config.thread_mlockall = THREAD_PROFILE_MLOCKALL;
+
+  return config;
+}
+
+struct Field {
+  const char *key;
+  std::variant<int Config::*, uint32_t Config::*, double Config::*,
+               std::string Config::*>
+      member;
+};
+
+static const Field fields[] = {
+    {"codec2_mode", &Config::codec2_mode},
+    {"session_silence_samples", &Config::session_silence_samples},
+    {"pcm_queue_size", &Config::pcm_queue_size},
+    {"codec2_queue_size", &Config::codec2_queue_size},
+    {"dtx_silence_dbfs", &Config::dtx_silence_dbfs},
+    {"dtx_hangover_frames", &Config::dtx_hangover_frames},
+    {"dtx_sid_interval", &Config::dtx_sid_interval},
+    {"bitrate_high_water", &Config::bitrate_high_water},
+    {"bitrate_low_water", &Config::bitrate_low_water},
+    {"bitrate_encode_high", &Config::bitrate_encode_high},
+    {"bitrate_encode_low", &Config::bitrate_encode_low},
+    {"bitrate_down_frames", &Config::bitrate_down_frames},
+    {"bitrate_up_frames", &Config::bitrate_up_frames},
+    {"capture_match", &Config::capture_match},
+    {"capture_device_api", &Config::capture_device_api},
+    {"thread_capture_priority", &Config::thread_capture_priority},
+    {"thread_capture_cpu", &Config::thread_capture_cpu},
+    {"thread_encoder_priority", &Config::thread_encoder_priority},
+    {"thread_encoder_cpu", &Config::thread_encoder_cpu},
+    {"thread_decoder_priority", &Config::thread_decoder_priority},
+    {"thread_decoder_cpu", &Config::thread_decoder_cpu},
+    {"thread_pool_priority", &Config::thread_pool_priority},
+    {"thread_pool_cpu", &Config::thread_pool_cpu},
+    {"thread_mlockall", &Config::thread_mlockall},
+};
+
+static const struct {
+  const char *name;
+  int mode;
+} mode_names[] = {
+    {"3200", CODEC2_MODE_3200},
+    {"2400", CODEC2_MODE_2400},
+    {"1300", CODEC2_MODE_1300},
+    {"700C", CODEC2_MODE_700C},
+};
+static_assert(std::size(mode_names) == CODEC2_MODES_N);
+
+static std::string trim(const std::string &s) {
+  size_t begin = s.find_first_not_of(" \t\r");
+  if (begin == std::string::npos)
+    return "";
+  return s.substr(begin, s.find_last_not_of(" \t\r") - begin + 1);
+}
+
+// Whole-string numbers only, "12abc" and "" are errors
+static bool parse_long(const std::string &s, long &out) {
+  char *end;
+  errno = 0;
+  out = strtol(s.c_str(), &end, 10);
+  return !s.empty() && *end == '\0' && errno == 0;
+}
+
+static bool parse_value(const Field &field, const std::string &value,
+                        Config &config) {
+  if (std::string(field.key) == "codec2_mode") {
+    for (auto &m : mode_names) {
+      if (value == m.name) {
+        config.codec2_mode = m.mode;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  return std::visit(
+      [&](auto member) {
+        using T = std::remove_cvref_t<decltype(config.*member)>;
+        if constexpr (std::is_same_v<T, std::string>) {
+          config.*member = value;
+          return true;
+        } else if constexpr (std::is_same_v<T, double>) {
+          char *end;
+          double d = strtod(value.c_str(), &end);
+          if (value.empty() || *end != '\0')
+            return false;
+          config.*member = d;
+          return true;
+        } else {
+          long l;
+          if (!parse_long(value, l) || l < std::numeric_limits<T>::min() ||
+              l > std::numeric_limits<T>::max())
+            return false;
+          config.*member = static_cast<T>(l);
+          return true;
+        }
+      },
+      field.member);
+}
+
+static std::string print_value(const Field &field, const Config &config) {
+  if (std::string(field.key) == "codec2_mode") {
+    for (auto &m : mode_names)
+      if (config.codec2_mode == m.mode)
+        return m.name;
+  }
+
+  return std::visit(
+      [&](auto member) -> std::string {
+        using T = std::remove_cvref_t<decltype(config.*member)>;
+        if constexpr (std::is_same_v<T, std::string>) {
+          return "\"" + config.*member + "\"";
+        } else {
+          std::ostringstream out;
+          out << config.*member;
+          return out.str();
+        }
+      },
+      field.member);
+}
+
+// Empty if the settings work together
+static std::string validate(const Config &c) {
+  if (c.session_silence_samples == 0)
+    return "session_silence_samples must be positive";
+  if (c.pcm_queue_size < 2 || c.codec2_queue_size < 2)
+    return "queue sizes must be at least 2";
+#ifdef STATIC_FOOTPRINT
+  // The arena was sized for the compiled-in queues
+  if (c.pcm_queue_size > PCM_QUEUE_SIZE ||
+      c.codec2_queue_size > CODEC2_QUEUE_SIZE)
+    return "queue sizes cannot exceed the static footprint budget (" +
+           std::to_string(PCM_QUEUE_SIZE) + ", " +
+           std::to_string(CODEC2_QUEUE_SIZE) + ")";
+#endif
+  if (c.dtx_silence_dbfs < -127 || c.dtx_silence_dbfs > 0)
+    return "dtx_silence_dbfs must be within [-127, 0]";
+  if (c.dtx_sid_interval == 0)
+    return "dtx_sid_interval must be positive";
+  if (!(0 <= c.bitrate_low_water &&
+        c.bitrate_low_water < c.bitrate_high_water &&
+        c.bitrate_high_water <= 1))
+    return "bitrate water marks need 0 <= low < high <= 1";
+  if (!(0 <= c.bitrate_encode_low &&
+        c.bitrate_encode_low < c.bitrate_encode_high))
+    return "bitrate encode limits need 0 <= low < high";
+  if (c.bitrate_down_frames == 0 || c.bitrate_up_frames == 0)
+    return "bitrate_down_frames and bitrate_up_frames must be positive";
+  for (int priority : {c.thread_capture_priority, c.thread_encoder_priority,
+                       c.thread_decoder_priority, c.thread_pool_priority})
+    if (priority < 0 || priority > 99)
+      return "thread priorities must be within [0, 99]";
+  for (int cpu : {c.thread_capture_cpu, c.thread_encoder_cpu,
+                  c.thread_decoder_cpu, c.thread_pool_cpu})
+    if (cpu < -1)
+      return "thread CPUs must be -1 or a CPU number";
+  if (c.thread_mlockall > 1)
+    return "thread_mlockall must be 0 or 1";
+  return "";
+}
+
+Config config_parse(const std::string &path) {
+  std::ifstream file(path);
+  if (!file)
+    throw std::runtime_error("Cannot open config " + path);
+
+  Config config = config_defaults();
+
+  std::string line;
+  for (int line_n = 1; std::getline(file, line); ++line_n) {
+    std::string where = path + ":" + std::to_string(line_n) + ": ";
+
+    line = trim(line.substr(0, line.find('#')));
+    if (line.empty())
+      continue;
+
+    size_t eq = line.find('=');
+    if (eq == std::string::npos)
+      throw std::runtime_error(where + "expected key = value");
+
+    std::string key = trim(line.substr(0, eq));
+    std::string value = trim(line.substr(eq + 1));
+    if (value.size() >= 2 && value.front() == '"' && value.back() == '"')
+      value = value.substr(1, value.size() - 2);
+
+    const Field *field = nullptr;
+    for (auto &f : fields)
+      if (key == f.key)
+        field = &f;
+
+    if (!field)
+      throw std::runtime_error(where + "unknown setting " + key);
+    if (!parse_value(*field, value, config))
+      throw std::runtime_error(where + "invalid " + key + " '" + value + "'");
+  }
+
+  std::string error = validate(config);
+  if (!error.empty())
+    throw std::runtime_error(path + ": " + error);
+
+  return config;
+}
+
+// Readers only ever see fully built snapshots through current. Replaced
+// snapshots are retired, not freed: a frame may still be using one, and a
+// few hundred bytes per reload is cheaper than tracking readers.
+static Config default_config = config_defaults();
+static std::atomic<const Config *> current{&default_config};
+
+static std::mutex reload_mutex;
+static std::vector<std::unique_ptr<const Config>> snapshots;
+static std::string config_path;
+
+const Config *config_current() {
+  return current.load(std::memory_order_acquire);
+}
+
+static void publish(Config config) {
+  const Config *old = current.load(std::memory_order_relaxed);
+
+  for (auto &field : fields) {
+    std::string before = print_value(field, *old);
+    std::string after = print_value(field, config);
+    if (before != after)
+      std::cout << "config: " << field.key << " " << before << " -> " << after
+                << std::endl;
+  }
+
+  snapshots.push_back(std::make_unique<const Config>(std::move(config)));
+  current.store(snapshots.back().get(), std::memory_order_release);
+}
+
+void config_init(const std::string &path) {
+  std::lock_guard<std::mutex> lock(reload_mutex);
+  config_path = path;
+
+  if (!std::ifstream(path)) {
+    std::cout << "config: no " << path << ", using the built-in defaults"
+              << std::endl;
+    return;
+  }
+
+  publish(config_parse(path));
+  std::cout << "config: loaded " << path << std::endl;
+}
+
+bool config_reload(std::string &error) {
+  std::lock_guard<std::mutex> lock(reload_mutex);
+
+  try {
+    publish(config_parse(config_path));
+  } catch (const std::exception &ex) {
+    error = ex.what();
+    std::cerr << "config: reload failed, keeping the current settings: "
+              << error << std::endl;
+    return false;
+  }
+
+  std::cout << "config: reloaded " << config_path << std::endl;
+  return true;
+}
@@ -0,0 +1,136 @@
+#include "dtx.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+static uint8_t frame_level(const PcmData &pcm_data) {
+  if (pcm_data.samples_n == 0)
+    return 0;
+
+  double energy = 0;
+  for (uint32_t i = 0; i < pcm_data.samples_n; ++i)
+    energy += static_cast<double>(pcm_data.samples[i]) * pcm_data.samples[i];
+  energy /= pcm_data.samples_n;
+
+  if (energy < 1.0)
+    return 0;
+
+  double dbfs = 10.0 * std::log10(energy / (32768.0 * 32768.0));
+  return static_cast<uint8_t>(std::clamp(std::lround(dbfs) + 128L, 0L, 255L));
+}
+
+Dtx::Decision Dtx::update(const PcmData &pcm_data,
+                          const Config &config) {
+  if (pcm_data.session_id != this->session_id) {
+    this->session_id = pcm_data.session_id;
+    this->hangover = 0;
+    this->silent = false;
+  }
+
+  this->level = frame_level(pcm_data);
+
+  if (this->level >= config.dtx_silence_dbfs + 128) {
+    this->hangover = config.dtx_hangover_frames;
+    this->silent = false;
+    ++this->frames_voice;
+    return Decision::Voice;
+  }
+
+  if (this->hangover > 0) {
+    --this->hangover;
+    ++this->frames_voice;
+    return Decision::Voice;
+  }
+
+  // First silent frame after speech always carries a SID
+  if (!this->silent || ++this->since_sid >= config.dtx_sid_interval) {
+    this->silent = true;
+    this->since_sid = 0;
+    ++this->frames_sid;
+    return Decision::Sid;
+  }
+
+  ++this->frames_suppressed;
+  return Decision::Suppress;
+}
+
+Codec2Data Dtx::sid_frame(const PcmData &pcm_data) const {
+  Codec2Data sid;
+
+  sid.stream_id = pcm_data.stream_id;
+  sid.session_id = pcm_data.session_id;
+  sid.piece_id = pcm_data.piece_id;
+  sid.type = FrameType::Sid;
+  sid.mode = 0;
+  sid.n_bytes = 1;
+  memset(sid.bytes, 0, sizeof(sid.bytes));
+  sid.bytes[0] = this->level;
+
+  return sid;
+}
+
+void Dtx::add_encoded(uint64_t ns, uint32_t n_bytes) {
+  this->encode_ns += ns;
+  this->bytes_voice += n_bytes;
+}
+
+void Dtx::report() const {
+  uint64_t total = frames_voice + frames_sid + frames_suppressed;
+  if (total == 0)
+    return;
+
+  uint64_t not_encoded = frames_sid + frames_suppressed;
+  double avg_encode_us =
+      frames_voice ? encode_ns / 1000.0 / frames_voice : 0.0;
+
+  // Suppressed and SID frames would have cost an average voice frame, a SID
+  // only needs the level byte on the wire
+  double avg_voice_bytes =
+      frames_voice ? static_cast<double>(bytes_voice) / frames_voice : 0.0;
+  uint64_t bytes_sent = bytes_voice + frames_sid;
+  uint64_t bytes_full = bytes_voice + avg_voice_bytes * not_encoded;
+  uint64_t bytes_saved = bytes_full - std::min(bytes_full, bytes_sent);
+
+  std::cout << "dtx: frames=" << total << " voice=" << frames_voice
+            << " sid=" << frames_sid << " suppressed=" << frames_suppressed
+            << " (" << 100.0 * not_encoded / total << "% not encoded)"
+            << std::endl;
+  std::cout << "dtx: avg encode " << avg_encode_us << " us, saved ~"
+            << avg_encode_us * not_encoded / 1000.0 << " ms CPU, "
+            << 8 * bytes_saved << " of " << 8 * bytes_full
+            << " bits" << std::endl;
+}
+
+void ComfortNoise::set_level(uint8_t level) {
+  if (level == 0) {
+    this->rms = 0;
+    return;
+  }
+
+  this->rms =
+      32768.0f * std::pow(10.0f, (static_cast<int>(level) - 128) / 20.0f);
+}
+
+PcmData ComfortNoise::generate(uint32_t stream_id, uint32_t session_id,
+                               uint32_t piece_id) {
+  PcmData pcm_data;
+
+  pcm_data.stream_id = stream_id;
+  pcm_data.session_id = session_id;
+  pcm_data.piece_id = piece_id;
+  pcm_data.samples_n = PCM_SAMPLE_MAX;
+
+  // Uniform noise in [-1, 1) has an RMS of 1/sqrt(3)
+  const float scale = this->rms * 1.7320508f;
+
+  for (uint32_t i = 0; i < PCM_SAMPLE_MAX; ++i) {
+    this->seed = this->seed * 1664525u + 1013904223u;
+    float u = static_cast<int32_t>(this->seed) / 2147483648.0f;
+    pcm_data.samples[i] = static_cast<int16_t>(
+        std::clamp(u * scale, -32768.0f, 32767.0f));
+  }
+
+  return pcm_data;
+}
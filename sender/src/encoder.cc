@@ -1,37 +1,131 @@
 #include "encoder.h"
+#include "trace.h"
 
 #include <cassert>
 #include <iostream>
 
-Encoder::Encoder() {
-  codec2 = codec2_create(CODEC2_MODE);
-  size_t nsam = codec2_samples_per_frame(codec2);
-  assert(nsam == PCM_SAMPLE_MAX);
-  size_t bytes_per_frame = codec2_bytes_per_frame(codec2);
-  std::cout << "bytes_per_frame: " << bytes_per_frame << std::endl;
-  assert(bytes_per_frame == CODEC2_FRAME_MAX);
+Encoder::Encoder(bool pooled) {
+#ifdef ENCODER_CODEC2_POOL
+  if (pooled)
+    pool = std::make_unique<Codec2Pool>();
+#else
+  (void)pooled;
+#endif
+
+  for (int i = 0; i < CODEC2_MODES_N; ++i) {
+    codec2[i] = fresh_state(i);
+    nsam[i] = codec2_samples_per_frame(codec2[i]);
+    assert(PCM_SAMPLE_MAX % nsam[i] == 0);
+    bytes_per_frame[i] = codec2_bytes_per_frame(codec2[i]);
+    std::cout << "mode " << CODEC2_MODES[i]
+              << " bytes_per_frame: " << bytes_per_frame[i] << std::endl;
+    assert(bytes_per_frame[i] * (PCM_SAMPLE_MAX / nsam[i]) <=
+           CODEC2_FRAME_MAX);
+  }
+}
+
+Encoder::~Encoder() {
+  for (int i = 0; i < CODEC2_MODES_N; ++i)
+    codec2_destroy(codec2[i]);
+}
+
+uint64_t Encoder::pool_misses() const {
+#ifdef ENCODER_CODEC2_POOL
+  if (pool)
+    return pool->misses();
+#endif
+  return 0;
+}
+
+CODEC2 *Encoder::fresh_state(int idx) {
+#ifdef ENCODER_CODEC2_POOL
+  if (pool)
+    return pool->acquire(idx);
+#endif
+  return codec2_create(CODEC2_MODES[idx]);
+}
+
+void Encoder::begin_session(uint32_t stream_id, uint32_t session_id) {
+  if (stream_id == this->stream_id && session_id == this->session_id)
+    return;
+
+  this->stream_id = stream_id;
+  this->session_id = session_id;
+
+  for (int i = 0; i < CODEC2_MODES_N; ++i) {
+    if (!used[i])
+      continue;
+
+#ifdef ENCODER_CODEC2_POOL
+    if (pool)
+      pool->release(codec2[i]);
+    else
+      codec2_destroy(codec2[i]);
+#else
+    codec2_destroy(codec2[i]);
+#endif
+    codec2[i] = fresh_state(i);
+    used[i] = false;
+  }
 }
 
-Encoder::~Encoder() { codec2_destroy(codec2); }
+CODEC2 *Encoder::codec(int idx) {
+  used[idx] = true;
+  return codec2[idx];
+}
+
+Codec2Data Encoder::encode(PcmData &pcm_data, int mode) {
+  TRACE_SCOPE("Encoder::encode");
 
-Codec2Data Encoder::encode(PcmData &pcm_data) {
   Codec2Data compressed_frame;
 
+  compressed_frame.stream_id = pcm_data.stream_id;
+  compressed_frame.session_id = pcm_data.session_id;
+  compressed_frame.piece_id = pcm_data.piece_id;
+  compressed_frame.type = FrameType::Voice;
+  compressed_frame.mode = mode;
+  compressed_frame.n_bytes = 0;
+
   assert(pcm_data.samples_n == PCM_SAMPLE_MAX);
 
-  codec2_encode(this->codec2, compressed_frame.bytes, pcm_data.samples);
+  int idx = codec2_mode_index(mode);
+  assert(idx >= 0);
+
+  begin_session(pcm_data.stream_id, pcm_data.session_id);
+  CODEC2 *codec2 = codec(idx);
+
+  for (size_t off = 0; off < PCM_SAMPLE_MAX; off += nsam[idx]) {
+    codec2_encode(codec2,
+                  &compressed_frame.bytes[compressed_frame.n_bytes],
+                  &pcm_data.samples[off]);
+    compressed_frame.n_bytes += bytes_per_frame[idx];
+  }
 
   return compressed_frame;
 }
 
 PcmData Encoder::decode(Codec2Data &codec2_data) {
+  TRACE_SCOPE("Encoder::decode");
+
   PcmData pcm_data;
 
-  codec2_decode(this->codec2, pcm_data.samples, codec2_data.bytes);
+  int idx = codec2_mode_index(codec2_data.mode);
+  assert(idx >= 0);
+
+  begin_session(codec2_data.stream_id, codec2_data.session_id);
+  CODEC2 *codec2 = codec(idx);
+
+  size_t in_off = 0;
+  for (size_t off = 0; off < PCM_SAMPLE_MAX; off += nsam[idx]) {
+    codec2_decode(codec2, &pcm_data.samples[off],
+                  &codec2_data.bytes[in_off]);
+    in_off += bytes_per_frame[idx];
+  }
 
   pcm_data.samples_n = PCM_SAMPLE_MAX;
-  pcm_data.session_id = 0;
-  pcm_data.piece_id = 0;
+  pcm_data.stream_id = codec2_data.stream_id;
+  pcm_data.session_id = codec2_data.session_id;
+  pcm_data.piece_id = codec2_data.piece_id;
 
   return pcm_data;
 }
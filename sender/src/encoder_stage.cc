@@ -0,0 +1,110 @@
+#include "encoder_stage.h"
+
+#include <iomanip>
+#include <iostream>
+
+EncoderStage::EncoderStage(MsgQueue<PcmData> *pcm_queue,
+                           MsgQueue<Codec2Data> *codec2_queue,
+                           StageMetrics *metrics)
+    : pcm_queue(pcm_queue), codec2_queue(codec2_queue), metrics(metrics) {
+  metrics->set(Gauge::Codec2Mode, mode);
+}
+
+void EncoderStage::process(PcmData &data) {
+  uint64_t encode_start = metrics_now_ns();
+  // One snapshot per frame, a reload takes effect from the next one
+  const Config *config = config_current();
+  metrics->observe(Histogram::QueueWait, encode_start - data.timestamp_ns);
+
+  jitter.wake(data.piece_id * FRAME_PERIOD_NS,
+              data.session_id != jitter_session);
+  jitter_session = data.session_id;
+
+  // Only sessions that open with speech are timed, one opening with a SID
+  // never encodes its first frame
+  bool first_frame = data.session_id != session_id;
+  session_id = data.session_id;
+
+#ifdef ENCODER_DTX
+  Dtx::Decision decision = dtx.update(data, *config);
+
+  if (decision == Dtx::Decision::Suppress) {
+    metrics->add(Counter::FramesSuppressed);
+    return;
+  }
+
+  if (decision == Dtx::Decision::Sid) {
+    metrics->add(Counter::FramesSid);
+    if (!codec2_queue->send(dtx.sid_frame(data)))
+      metrics->add(Counter::FramesDropped);
+    return;
+  }
+#endif
+
+#ifndef ENCODER_ADAPTIVE_BITRATE
+  mode = config->codec2_mode;
+  metrics->set(Gauge::Codec2Mode, mode);
+#endif
+  Codec2Data codec2_data = encoder.encode(data, mode);
+
+  uint64_t encode_end = metrics_now_ns();
+  uint64_t encode_ns = encode_end - encode_start;
+  metrics->observe(Histogram::Encode, encode_ns);
+
+  // Includes picking up fresh codec states for the new session
+  if (first_frame)
+    metrics->observe(Histogram::FirstFrame, encode_end - data.timestamp_ns);
+
+  metrics->add(Counter::FramesEncoded);
+  if (encode_ns > FRAME_PERIOD_NS)
+    metrics->add(Counter::DeadlineMisses);
+
+#ifdef ENCODER_DTX
+  dtx.add_encoded(encode_ns, codec2_data.n_bytes);
+#endif
+
+  bool sent = codec2_queue->send(codec2_data);
+  if (!sent)
+    metrics->add(Counter::FramesDropped);
+
+#ifdef ENCODER_ADAPTIVE_BITRATE
+  mode = bitrate.update({.pcm_depth = pcm_queue->size(),
+                         .pcm_capacity = pcm_queue->capacity(),
+                         .out_depth = codec2_queue->size(),
+                         .out_capacity = codec2_queue->capacity(),
+                         .encode_ns = encode_ns,
+                         .dropped = !sent},
+                        *config);
+  metrics->set(Gauge::Codec2Mode, mode);
+#endif
+
+  // std::cout << "encoder " << data.session_id << "." << data.piece_id;
+  // std::cout << " :: ";
+  // std::cout << std::hex << std::setw(2) << std::setfill('0');
+
+  // for (size_t i = 0; i < codec2_data.n_bytes; ++i) {
+  //   std::cout << static_cast<int>(codec2_data.bytes[i]) << " ";
+  // }
+
+  // std::cout << std::dec;
+  // std::cout << std::endl;
+}
+
+void EncoderStage::run() {
+  while (auto maybe_data = pcm_queue->recv()) {
+    PcmData data = std::move(*maybe_data);
+    process(data);
+  }
+}
+
+void EncoderStage::report() const {
+  std::cout << "encoder: codec2 pool misses=" << encoder.pool_misses()
+            << std::endl;
+  jitter.report("encoder");
+#ifdef ENCODER_DTX
+  dtx.report();
+#endif
+#ifdef ENCODER_ADAPTIVE_BITRATE
+  bitrate.report();
+#endif
+}
@@ -0,0 +1,105 @@
+#include "executor.h"
+
+static thread_local ExecutorWorker *current_worker = nullptr;
+
+// One thread and its ready list. Producers push onto an intrusive stack
+// with a CAS, the worker takes the whole stack at once and runs it oldest
+// first, so there is no ABA and no lock on either side.
+class ExecutorWorker {
+public:
+  explicit ExecutorWorker(ThreadStage stage)
+      : thread([this, stage] { run(stage); }) {}
+
+  ~ExecutorWorker() {
+    // A node without a coroutine stops the worker after what is queued
+    push(&stop);
+    thread.join();
+  }
+
+  void push(ExecutorNode *node) noexcept {
+    ExecutorNode *head = ready.load(std::memory_order_relaxed);
+    do {
+      node->next = head;
+    } while (!ready.compare_exchange_weak(head, node,
+                                          std::memory_order_release,
+                                          std::memory_order_relaxed));
+
+    // Only an empty list can have the worker asleep on it
+    if (!head)
+      ready.notify_one();
+  }
+
+private:
+  void run(ThreadStage stage) {
+    thread_profile_apply(stage);
+    current_worker = this;
+
+    while (true) {
+      ExecutorNode *list = ready.exchange(nullptr, std::memory_order_acquire);
+      if (!list) {
+        ready.wait(nullptr, std::memory_order_acquire);
+        continue;
+      }
+
+      ExecutorNode *fifo = nullptr;
+      while (list) {
+        ExecutorNode *next = list->next;
+        list->next = fifo;
+        fifo = list;
+        list = next;
+      }
+
+      while (fifo) {
+        // The coroutine may suspend on the same node again once resumed
+        ExecutorNode *next = fifo->next;
+        if (!fifo->handle)
+          return;
+        fifo->handle.resume();
+        fifo = next;
+      }
+    }
+  }
+
+  std::atomic<ExecutorNode *> ready = nullptr;
+  ExecutorNode stop;
+  std::thread thread;
+};
+
+Executor::Executor(size_t threads, ThreadStage stage) {
+  for (size_t i = 0; i < threads; ++i)
+    workers.push_back(std::make_unique<ExecutorWorker>(stage));
+}
+
+Executor::~Executor() {
+  size_t live;
+  while ((live = live_tasks.load(std::memory_order_acquire)) != 0)
+    live_tasks.wait(live, std::memory_order_acquire);
+
+  workers.clear();
+}
+
+void Executor::spawn(Task task) {
+  auto handle = std::exchange(task.handle, {});
+  auto &promise = handle.promise();
+
+  promise.executor = this;
+  promise.start.handle = handle;
+  promise.start.worker =
+      workers[next_worker.fetch_add(1, std::memory_order_relaxed) %
+              workers.size()]
+          .get();
+
+  live_tasks.fetch_add(1, std::memory_order_relaxed);
+  schedule(&promise.start);
+}
+
+void Executor::schedule(ExecutorNode *node) noexcept {
+  node->worker->push(node);
+}
+
+ExecutorWorker *Executor::current() noexcept { return current_worker; }
+
+void Executor::task_done() noexcept {
+  if (live_tasks.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    live_tasks.notify_all();
+}
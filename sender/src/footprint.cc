@@ -0,0 +1,110 @@
+#include "footprint.h"
+#include "arena.h"
+#include "capture_trace.h"
+#include "codec2_pool.h"
+#include "data.h"
+#include "encoder.h"
+#include "pipeline.h"
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+// Threads outside the device pipelines: main, PipeWire, its data loop and
+// the metrics server
+#define FOOTPRINT_SHARED_THREADS 4
+
+FootprintBudget footprint_budget(uint32_t streams) {
+  FootprintBudget budget = {};
+  budget.streams = streams;
+  budget.baseline = FOOTPRINT_BASELINE_BYTES;
+
+  // The decoder debugger runs on the shared executor, not a thread of its
+  // own, and decodes without a pool
+#ifdef DECODER_DEBUGGER
+  uint32_t decoders = 1;
+  uint32_t shared_threads = FOOTPRINT_SHARED_THREADS + EXECUTOR_THREADS;
+#else
+  uint32_t decoders = 0;
+  uint32_t shared_threads = FOOTPRINT_SHARED_THREADS;
+#endif
+
+  budget.pcm_queues = streams * arena_queue_bytes<PcmData>(PCM_QUEUE_SIZE);
+  budget.codec2_queues =
+      streams * arena_queue_bytes<Codec2Data>(CODEC2_QUEUE_SIZE);
+
+  // The encoder holds a state per mode, its pool another CODEC2_POOL_SIZE
+  // ready ones plus the one being replaced
+  size_t states_per_mode = 1;
+  uint32_t threads_per_stream = 1;
+#ifdef ENCODER_CODEC2_POOL
+  budget.codec2_pools = streams * Codec2Pool::arena_bytes();
+  states_per_mode += CODEC2_POOL_SIZE + 1;
+  threads_per_stream += 1;
+#endif
+
+#ifdef CAPTURE_RECORD
+  budget.capture_record = CaptureRecorder::arena_bytes();
+#endif
+
+  size_t state_bytes = 0;
+  for (int i = 0; i < CODEC2_MODES_N; ++i)
+    state_bytes += Codec2Pool::state_bytes(i);
+  budget.codec2_states =
+      streams * (states_per_mode + decoders) * state_bytes;
+
+  budget.stacks = (streams * threads_per_stream + shared_threads) *
+                  size_t(FOOTPRINT_STACK_BYTES);
+  budget.pipewire = FOOTPRINT_PIPEWIRE_BYTES;
+  budget.slack = FOOTPRINT_SLACK_BYTES;
+
+  return budget;
+}
+
+static void report_line(const char *what, size_t bytes) {
+  std::cout << "footprint:   " << std::left << std::setw(16) << what
+            << std::right << std::setw(8) << (bytes + 1023) / 1024 << " KiB"
+            << std::endl;
+}
+
+void footprint_report(const FootprintBudget &budget) {
+  std::cout << "footprint: budget for " << budget.streams << " streams"
+            << std::endl;
+  report_line("baseline", budget.baseline);
+  report_line("pcm queues", budget.pcm_queues);
+  report_line("codec2 queues", budget.codec2_queues);
+  report_line("codec2 pools", budget.codec2_pools);
+  report_line("capture record", budget.capture_record);
+  report_line("codec2 states", budget.codec2_states);
+  report_line("thread stacks", budget.stacks);
+  report_line("pipewire", budget.pipewire);
+  report_line("slack", budget.slack);
+  report_line("total", budget.total());
+
+  std::cout << "footprint: arena " << (arena_used() + 1023) / 1024 << " of "
+            << (arena_capacity() + 1023) / 1024 << " KiB used, "
+            << (arena_locked() ? "locked" : "not locked") << std::endl;
+  std::cout << "footprint: rss " << footprint_rss() / 1024 << " KiB, peak "
+            << footprint_peak_rss() / 1024 << " KiB" << std::endl;
+}
+
+size_t footprint_rss() {
+  std::ifstream statm("/proc/self/statm");
+  size_t size = 0, resident = 0;
+  if (!(statm >> size >> resident))
+    return 0;
+
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+size_t footprint_peak_rss() {
+  rusage usage{};
+  if (getrusage(RUSAGE_SELF, &usage) < 0)
+    return 0;
+
+  // Linux reports kilobytes
+  return static_cast<size_t>(usage.ru_maxrss) * 1024;
+}
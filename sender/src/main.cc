@@ -1,17 +1,21 @@
-#include "MsgQueue.h"
-#include "data.h"
-#include "encoder.h"
+#include "arena.h"
+#include "codec2_build.h"
+#include "config.h"
+#include "footprint.h"
+#include "metrics.h"
+#include "pipeline.h"
 #include "pw-stream.h"
-#include "wav_file.h"
+#include "thread_profile.h"
+#include "trace.h"
 
 #include <csignal>
 #include <cstdlib>
-#include <iomanip>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <pthread.h>
 #include <thread>
-
-#define DECODER_DEBUGGER 1
+#include <vector>
 
 static pthread_t pw_thread;
 
@@ -20,24 +24,83 @@ static void sigint_handler(int) {
   pthread_kill(pw_thread, SIGINT);
 }
 
+static void sighup_handler(int) { pthread_kill(pw_thread, SIGHUP); }
+
+#ifdef PIPELINE_TRACE
+static void sigusr1_handler(int) { pthread_kill(pw_thread, SIGUSR1); }
+#endif
+
 static void install_sig_handler() {
   // Install handler in main that forwards SIGINT
   struct sigaction sa{};
   sa.sa_handler = sigint_handler;
   sigemptyset(&sa.sa_mask);
   sigaction(SIGINT, &sa, nullptr);
+
+  // SIGHUP reloads the config from the PipeWire loop
+  sa.sa_handler = sighup_handler;
+  sigaction(SIGHUP, &sa, nullptr);
+
+#ifdef PIPELINE_TRACE
+  // SIGUSR1 dumps the trace from the PipeWire loop
+  sa.sa_handler = sigusr1_handler;
+  sigaction(SIGUSR1, &sa, nullptr);
+#endif
 }
 
-int main() {
-  MsgQueue<PcmData> pcm_queue(64);
-  MsgQueue<Codec2Data> codec2_queue(64);
+int main(int argc, char **argv) {
+  try {
+    codec2_build_check();
+    config_init(argc > 1 ? argv[1] : CONFIG_PATH);
+  } catch (const std::exception &ex) {
+    std::cerr << "Error: " << ex.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // A pipeline unregisters its metrics when destroyed, so clearing them
+  // while the metrics server runs is safe
+  std::mutex pipelines_mutex;
+  std::vector<std::unique_ptr<DevicePipeline>> pipelines;
 
   install_sig_handler();
 
-  std::thread pw_worker([&pcm_queue] {
+  thread_profile_lock_memory();
+
+#ifdef STATIC_FOOTPRINT
+  // Reserve what the pipelines need before the first device shows up
+  FootprintBudget budget = footprint_budget(FOOTPRINT_MAX_STREAMS);
+  arena_init(budget.arena());
+  footprint_report(budget);
+#endif
+
+  MetricsServer metrics_server(METRICS_SOCKET_PATH, METRICS_TCP_PORT);
+
+  std::thread pw_worker([&pipelines, &pipelines_mutex] {
     try {
       pw_thread = pthread_self();
-      PwStream pw_stream(&pcm_queue);
+      auto open_device = [&pipelines, &pipelines_mutex](
+                             uint32_t stream_id, const std::string &name) {
+        std::lock_guard<std::mutex> lock(pipelines_mutex);
+#ifdef STATIC_FOOTPRINT
+        if (pipelines.size() == FOOTPRINT_MAX_STREAMS) {
+          std::cerr << "footprint: no budget left for " << name << std::endl;
+          return static_cast<PcmFramer *>(nullptr);
+        }
+#endif
+        pipelines.push_back(std::make_unique<DevicePipeline>(stream_id, name));
+        return pipelines.back()->framer();
+      };
+
+      // Its threads, queues and codec states go. Under the footprint
+      // profile its place and arena blocks go to the next device.
+      auto close_device = [&pipelines, &pipelines_mutex](uint32_t stream_id) {
+        std::lock_guard<std::mutex> lock(pipelines_mutex);
+        std::erase_if(pipelines, [stream_id](const auto &pipeline) {
+          return pipeline->id() == stream_id;
+        });
+      };
+
+      PwStream pw_stream(open_device, close_device);
       pw_stream.run();
     } catch (const std::exception &ex) {
       std::cerr << "Error: " << ex.what() << "\n";
@@ -46,61 +109,22 @@ int main() {
     std::cout << "pw_worker Finished" << std::endl;
   });
 
-  std::thread encoder_worker([&pcm_queue, &codec2_queue] {
-    Encoder encoder = Encoder();
-    while (auto maybe_data = pcm_queue.recv()) {
-      PcmData data = std::move(*maybe_data);
-
-      Codec2Data codec2_data = encoder.encode(data);
-
-      codec2_queue.send(codec2_data);
-
-      // std::cout << "encoder " << data.session_id << "." << data.piece_id;
-      // std::cout << " :: ";
-      // std::cout << std::hex << std::setw(2) << std::setfill('0');
-
-      // for (size_t i = 0; i < CODEC2_FRAME_MAX; ++i) {
-      //   std::cout << static_cast<int>(codec2_data.bytes[i]) << " ";
-      // }
-
-      // std::cout << std::dec;
-      // std::cout << std::endl;
-    }
-
-    std::cout << "encoder_worker Finished" << std::endl;
-    std::cout << "Closing codec2_queue" << std::endl;
-
-    codec2_queue.close();
-  });
-
-#ifdef DECODER_DEBUGGER
-  std::thread decoder_debugger([&codec2_queue] {
-    Encoder encoder = Encoder();
-    WavFile wav_file = WavFile("recording.wav");
-
-    while (auto maybe_data = codec2_queue.recv()) {
-      Codec2Data data = std::move(*maybe_data);
-
-      PcmData pcm_data = encoder.decode(data);
-
-      wav_file.write_pcm(pcm_data);
-    }
-  });
-#endif
-
   // std::thread lora_sender([&codec2_queue] {
   // });
 
   std::cout << "Wait for pw_worker" << std::endl;
   pw_worker.join();
 
-  std::cout << "Wait for encoder_worker" << std::endl;
-  encoder_worker.join();
+  // Capture streams are gone, closing the pipelines drains them
+  pipelines.clear();
 
-#ifdef DECODER_DEBUGGER
-  std::cout << "Wait for decoder_debugger" << std::endl;
-  decoder_debugger.join();
+#ifdef STATIC_FOOTPRINT
+  footprint_report(budget);
+  if (footprint_peak_rss() > budget.total())
+    std::cerr << "footprint: peak RSS exceeded the budget" << std::endl;
 #endif
 
+  TRACE_DUMP(TRACE_OUTPUT);
+
   return 0;
 }
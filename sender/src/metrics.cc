@@ -0,0 +1,345 @@
+#include "metrics.h"
+#include "config.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+static const char *counter_names[] = {
+    "frames_captured_total", "frames_encoded_total", "frames_dropped_total",
+    "frames_sid_total",      "frames_suppressed_total",
+    "deadline_misses_total", "pw_xruns_total",       "sessions_total",
+    "reconnects_total",
+};
+static_assert(std::size(counter_names) ==
+              static_cast<size_t>(Counter::Count));
+
+static const char *gauge_names[] = {
+    "codec2_mode",
+};
+static_assert(std::size(gauge_names) == static_cast<size_t>(Gauge::Count));
+
+static const char *histogram_names[] = {
+    "capture_callback_seconds",
+    "queue_wait_seconds",
+    "encode_seconds",
+    "reconnect_seconds",
+    "session_first_frame_seconds",
+    "wakeup_jitter_seconds",
+    "capture_latency_seconds",
+};
+static_assert(std::size(histogram_names) ==
+              static_cast<size_t>(Histogram::Count));
+
+static StageMetrics stages[METRICS_STAGES_MAX];
+// Writes to an unclaimed slot once all are taken, never exported
+static StageMetrics overflow_stage;
+static std::atomic<uint32_t> stages_n = 0;
+
+static std::mutex registry_mutex;
+struct SampledGauge {
+  std::string name;
+  std::string labels;
+  std::function<int64_t()> fn;
+  const void *owner;
+};
+
+static std::vector<SampledGauge> sampled_gauges;
+
+void StageMetrics::observe(Histogram h, uint64_t ns) {
+  uint32_t idx = static_cast<uint32_t>(h);
+
+  // Bucket i holds values up to 2^i us, the last one is +Inf
+  uint64_t us = (ns + 999) / 1000;
+  uint32_t bucket = us <= 1 ? 0 : std::bit_width(us - 1);
+  if (bucket >= METRICS_BUCKETS)
+    bucket = METRICS_BUCKETS - 1;
+
+  auto &b = buckets[idx][bucket];
+  b.store(b.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  auto &s = sums_ns[idx];
+  s.store(s.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+}
+
+StageMetrics *metrics_stage(const char *name, const void *owner) {
+  std::lock_guard<std::mutex> lock(registry_mutex);
+
+  // Slots released by a closed pipeline are taken again first
+  uint32_t n = stages_n.load(std::memory_order_relaxed);
+  uint32_t idx = 0;
+  while (idx < n && stages[idx].name)
+    ++idx;
+
+  if (idx == METRICS_STAGES_MAX) {
+    std::cerr << "metrics: no slot left for stage " << name << std::endl;
+    return &overflow_stage;
+  }
+
+  StageMetrics &stage = stages[idx];
+  for (auto &c : stage.counters)
+    c.store(0, std::memory_order_relaxed);
+  for (auto &g : stage.gauges)
+    g.store(0, std::memory_order_relaxed);
+  for (auto &h : stage.buckets)
+    for (auto &b : h)
+      b.store(0, std::memory_order_relaxed);
+  for (auto &s : stage.sums_ns)
+    s.store(0, std::memory_order_relaxed);
+
+  stage.name = name;
+  stage.owner = owner;
+  if (idx == n)
+    stages_n.store(idx + 1, std::memory_order_release);
+
+  return &stage;
+}
+
+void metrics_gauge(const std::string &name, const std::string &labels,
+                   std::function<int64_t()> fn, const void *owner) {
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  sampled_gauges.push_back({name, labels, std::move(fn), owner});
+}
+
+void metrics_unregister(const void *owner) {
+  std::lock_guard<std::mutex> lock(registry_mutex);
+
+  std::erase_if(sampled_gauges, [owner](const SampledGauge &gauge) {
+    return gauge.owner == owner;
+  });
+
+  uint32_t n = stages_n.load(std::memory_order_relaxed);
+  for (uint32_t i = 0; i < n; ++i) {
+    if (stages[i].name && stages[i].owner == owner) {
+      stages[i].name = nullptr;
+      stages[i].owner = nullptr;
+    }
+  }
+}
+
+uint64_t metrics_now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+std::string MetricsServer::render() {
+  std::ostringstream out;
+  // Held throughout, so no stage or gauge is unregistered mid scrape
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  uint32_t n = stages_n.load(std::memory_order_acquire);
+
+  for (uint32_t c = 0; c < static_cast<uint32_t>(Counter::Count); ++c) {
+    out << "# TYPE sender_" << counter_names[c] << " counter\n";
+    for (uint32_t i = 0; i < n; ++i) {
+      if (!stages[i].name)
+        continue;
+      out << "sender_" << counter_names[c] << "{stage=\"" << stages[i].name
+          << "\"} "
+          << stages[i].counters[c].load(std::memory_order_relaxed) << "\n";
+    }
+  }
+
+  for (uint32_t g = 0; g < static_cast<uint32_t>(Gauge::Count); ++g) {
+    out << "# TYPE sender_" << gauge_names[g] << " gauge\n";
+    for (uint32_t i = 0; i < n; ++i) {
+      if (!stages[i].name)
+        continue;
+      out << "sender_" << gauge_names[g] << "{stage=\"" << stages[i].name
+          << "\"} " << stages[i].gauges[g].load(std::memory_order_relaxed)
+          << "\n";
+    }
+  }
+
+  {
+    // Group series of the same gauge under one TYPE line
+    std::map<std::string, std::vector<const SampledGauge *>> by_name;
+    for (auto &gauge : sampled_gauges)
+      by_name[gauge.name].push_back(&gauge);
+
+    for (auto &[name, gauges] : by_name) {
+      out << "# TYPE sender_" << name << " gauge\n";
+      for (auto *gauge : gauges)
+        out << "sender_" << name << gauge->labels << " " << gauge->fn()
+            << "\n";
+    }
+  }
+
+  for (uint32_t h = 0; h < static_cast<uint32_t>(Histogram::Count); ++h) {
+    out << "# TYPE sender_" << histogram_names[h] << " histogram\n";
+    for (uint32_t i = 0; i < n; ++i) {
+      if (!stages[i].name)
+        continue;
+
+      uint64_t count = 0;
+      for (uint32_t b = 0; b < METRICS_BUCKETS; ++b) {
+        count += stages[i].buckets[h][b].load(std::memory_order_relaxed);
+        out << "sender_" << histogram_names[h] << "_bucket{stage=\""
+            << stages[i].name << "\",le=\"";
+        if (b + 1 == METRICS_BUCKETS)
+          out << "+Inf";
+        else
+          out << (1ull << b) / 1e6;
+        out << "\"} " << count << "\n";
+      }
+      out << "sender_" << histogram_names[h] << "_sum{stage=\""
+          << stages[i].name << "\"} "
+          << stages[i].sums_ns[h].load(std::memory_order_relaxed) / 1e9
+          << "\n";
+      out << "sender_" << histogram_names[h] << "_count{stage=\""
+          << stages[i].name << "\"} " << count << "\n";
+    }
+  }
+
+  return out.str();
+}
+
+MetricsServer::MetricsServer(const std::string &socket_path, uint16_t tcp_port)
+    : socket_path(socket_path) {
+  if (pipe(wake_fd) < 0)
+    throw std::runtime_error("Failed to create metrics wake pipe");
+
+  // Metrics are best effort, a listener that fails to bind is only reported
+  if (!socket_path.empty()) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+    unlink(socket_path.c_str());
+
+    unix_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (unix_fd < 0 ||
+        bind(unix_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+        listen(unix_fd, 4) < 0) {
+      std::cerr << "metrics: cannot listen on " << socket_path << ": "
+                << strerror(errno) << std::endl;
+      if (unix_fd >= 0)
+        close(unix_fd);
+      unix_fd = -1;
+    }
+  }
+
+  if (tcp_port != 0) {
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(tcp_port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int one = 1;
+    tcp_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (tcp_fd >= 0)
+      setsockopt(tcp_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (tcp_fd < 0 ||
+        bind(tcp_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+        listen(tcp_fd, 4) < 0) {
+      std::cerr << "metrics: cannot listen on 127.0.0.1:" << tcp_port << ": "
+                << strerror(errno) << std::endl;
+      if (tcp_fd >= 0)
+        close(tcp_fd);
+      tcp_fd = -1;
+    }
+  }
+
+  worker = std::thread([this] { serve(); });
+}
+
+MetricsServer::~MetricsServer() {
+  char c = 0;
+  if (write(wake_fd[1], &c, 1) < 0)
+    std::cerr << "metrics: failed to wake server" << std::endl;
+  worker.join();
+
+  if (unix_fd >= 0) {
+    close(unix_fd);
+    unlink(socket_path.c_str());
+  }
+  if (tcp_fd >= 0)
+    close(tcp_fd);
+  close(wake_fd[0]);
+  close(wake_fd[1]);
+}
+
+void MetricsServer::serve() {
+  pollfd fds[3] = {
+      {wake_fd[0], POLLIN, 0},
+      {unix_fd, POLLIN, 0},
+      {tcp_fd, POLLIN, 0},
+  };
+
+  while (true) {
+    if (poll(fds, 3, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+
+    if (fds[0].revents)
+      break;
+
+    for (int i = 1; i < 3; ++i) {
+      if (!(fds[i].revents & POLLIN))
+        continue;
+
+      int client = accept4(fds[i].fd, nullptr, nullptr, SOCK_CLOEXEC);
+      if (client < 0)
+        continue;
+
+      // A stuck client must not hold the server forever
+      timeval timeout = {1, 0};
+      setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+      // Drain whatever request line arrives shortly, anything but a reload
+      // gets the metrics
+      pollfd cfd = {client, POLLIN, 0};
+      char request[1024];
+      ssize_t request_n = 0;
+      if (poll(&cfd, 1, 100) > 0 &&
+          (request_n = read(client, request, sizeof(request))) < 0)
+        std::cerr << "metrics: failed to read request" << std::endl;
+
+      std::string status = "200 OK";
+      std::string body;
+      if (std::string_view(request, request_n > 0 ? request_n : 0)
+              .starts_with("POST /reload")) {
+        std::string error;
+        if (config_reload(error)) {
+          body = "reloaded\n";
+        } else {
+          status = "400 Bad Request";
+          body = error + "\n";
+        }
+      } else {
+        body = render();
+      }
+
+      std::string reply = "HTTP/1.0 " + status +
+                          "\r\n"
+                          "Content-Type: text/plain; version=0.0.4\r\n"
+                          "Content-Length: " +
+                          std::to_string(body.size()) + "\r\n\r\n" + body;
+
+      size_t off = 0;
+      while (off < reply.size()) {
+        ssize_t n = send(client, reply.data() + off, reply.size() - off,
+                         MSG_NOSIGNAL);
+        if (n <= 0)
+          break;
+        off += n;
+      }
+      close(client);
+    }
+  }
+}
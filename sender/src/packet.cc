@@ -0,0 +1,70 @@
+#include "packet.h"
+
+#include <time.h>
+
+#include <cstring>
+
+static void put_u32(uint8_t *p, uint32_t v) {
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+  return static_cast<uint32_t>(p[0]) << 24 | static_cast<uint32_t>(p[1]) << 16 |
+         static_cast<uint32_t>(p[2]) << 8 | p[3];
+}
+
+size_t packet_encode(const Packet &packet, uint8_t *buf) {
+  const Codec2Data &data = packet.data;
+
+  buf[0] = 'S';
+  buf[1] = 'C';
+  buf[2] = PACKET_VERSION;
+  buf[3] = static_cast<uint8_t>(data.type);
+  buf[4] = data.mode;
+  buf[5] = data.n_bytes;
+  buf[6] = 0;
+  buf[7] = 0;
+  put_u32(buf + PACKET_SENDER_ID_OFFSET, packet.sender_id);
+  put_u32(buf + PACKET_STREAM_ID_OFFSET, data.stream_id);
+  put_u32(buf + 16, data.session_id);
+  put_u32(buf + 20, data.piece_id);
+  put_u32(buf + 24, packet.sent_ns >> 32);
+  put_u32(buf + 28, packet.sent_ns);
+  memcpy(buf + PACKET_HEADER_SIZE, data.bytes, data.n_bytes);
+
+  return PACKET_HEADER_SIZE + data.n_bytes;
+}
+
+bool packet_decode(const uint8_t *buf, size_t size, Packet &packet) {
+  if (size < PACKET_HEADER_SIZE || buf[0] != 'S' || buf[1] != 'C' ||
+      buf[2] != PACKET_VERSION)
+    return false;
+
+  Codec2Data &data = packet.data;
+  data.n_bytes = buf[5];
+  if (data.n_bytes > CODEC2_FRAME_MAX ||
+      size != PACKET_HEADER_SIZE + size_t(data.n_bytes) ||
+      buf[3] > static_cast<uint8_t>(FrameType::Sid))
+    return false;
+
+  data.type = static_cast<FrameType>(buf[3]);
+  data.mode = buf[4];
+  packet.sender_id = get_u32(buf + PACKET_SENDER_ID_OFFSET);
+  data.stream_id = get_u32(buf + PACKET_STREAM_ID_OFFSET);
+  data.session_id = get_u32(buf + 16);
+  data.piece_id = get_u32(buf + 20);
+  packet.sent_ns = static_cast<uint64_t>(get_u32(buf + 24)) << 32 |
+                   get_u32(buf + 28);
+  memcpy(data.bytes, buf + PACKET_HEADER_SIZE, data.n_bytes);
+
+  return true;
+}
+
+uint64_t packet_now_ns() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
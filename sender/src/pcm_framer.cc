@@ -0,0 +1,114 @@
+#include "pcm_framer.h"
+#include "config.h"
+#include "wav_file.h"
+
+#include <cstring>
+
+PcmFramer::PcmFramer(uint32_t stream_id, MsgQueue<PcmData> *pcm_queue,
+                     StageMetrics *metrics)
+    : pcm_queue(pcm_queue), metrics(metrics) {
+  this->pcm_data.stream_id = stream_id;
+}
+
+void PcmFramer::reset_session() {
+  this->new_session = true;
+
+  this->pcm_data.session_id += 1;
+  this->pcm_data.piece_id = 0;
+  this->pcm_data.samples_n = 0;
+
+  this->zero_samples = 0;
+}
+
+void PcmFramer::interrupt() {
+  // The next source delivers on a clock of its own
+  this->samples_seen = 0;
+
+  if (this->new_session)
+    this->pcm_data.samples_n = 0;
+  else
+    this->reset_session();
+}
+
+void PcmFramer::send_data(const int16_t *samples, uint32_t n_samples) {
+  while (n_samples != 0) {
+    uint32_t copy_amount = PCM_SAMPLE_MAX - this->pcm_data.samples_n;
+
+    if (copy_amount > n_samples)
+      copy_amount = n_samples;
+
+    memcpy(&this->pcm_data.samples[this->pcm_data.samples_n], samples,
+           copy_amount * sizeof(int16_t));
+
+    n_samples -= copy_amount;
+    samples += copy_amount;
+
+    this->pcm_data.samples_n += copy_amount;
+
+    if (this->pcm_data.samples_n == PCM_SAMPLE_MAX)
+      this->emit_pcm_data();
+  }
+}
+
+void PcmFramer::emit_pcm_data() {
+  // std::cout << "emit_pcm_data " << this->pcm_data.session_id << "."
+  //           << this->pcm_data.piece_id << std::endl;
+
+  this->pcm_data.timestamp_ns = metrics_now_ns();
+
+  if (this->pcm_queue->send(this->pcm_data))
+    this->metrics->add(Counter::FramesCaptured);
+  else
+    this->metrics->add(Counter::FramesDropped);
+
+  if (this->debug_wav)
+    this->debug_wav->write_pcm(this->pcm_data);
+
+  this->pcm_data.piece_id += 1;
+  this->pcm_data.samples_n = 0;
+}
+
+void PcmFramer::process(const int16_t *samples, uint32_t n_samples) {
+  // Session change check: more than 1 sec of silence
+  // New session, only start sending if non zero data comes in
+  // Always starts with the first non zero sample
+
+  // Whenever PCM_SAMPLE_MAX samples are collected, send an object on the
+  // queue Signal via conditional variable
+
+  this->jitter.wake(this->samples_seen * 1000000000ull / 8000,
+                    this->samples_seen == 0);
+  this->samples_seen += n_samples;
+
+  uint32_t idx_first_nonzero = 0;
+
+  while (idx_first_nonzero < n_samples) {
+    if (samples[idx_first_nonzero] != 0)
+      break;
+    ++idx_first_nonzero;
+  }
+
+  if (this->new_session) {
+    if (idx_first_nonzero != n_samples) {
+      this->new_session = false;
+      this->metrics->add(Counter::Sessions);
+
+      this->send_data(&samples[idx_first_nonzero],
+                      n_samples - idx_first_nonzero);
+    }
+  } else {
+    this->send_data(samples, n_samples);
+
+    if (idx_first_nonzero == n_samples) {
+      this->zero_samples += n_samples;
+
+      // More than 1s of silence
+      if (this->zero_samples >= config_current()->session_silence_samples) {
+        // Reset the session
+        this->reset_session();
+      }
+    } else {
+      this->zero_samples = 0;
+    }
+  }
+}
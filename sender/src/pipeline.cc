@@ -0,0 +1,136 @@
+#include "pipeline.h"
+#include "bitrate.h"
+#include "dtx.h"
+#include "encoder.h"
+#include "encoder_stage.h"
+#include "metrics.h"
+#include "thread_profile.h"
+#include "wav_file.h"
+
+#include <iostream>
+
+#ifdef DECODER_DEBUGGER
+// Started with the first pipeline, stopped at exit once every pipeline
+// closed
+static Executor &pipeline_executor() {
+  static Executor executor(EXECUTOR_THREADS, ThreadStage::Decoder);
+  return executor;
+}
+#endif
+
+static std::string label_value(const std::string &s) {
+  std::string out = s;
+  for (char &c : out)
+    if (c == '"' || c == '\\' || c == '\n')
+      c = '_';
+  return out;
+}
+
+DevicePipeline::DevicePipeline(uint32_t stream_id, const std::string &name)
+    : stream_id(stream_id), name_(name),
+      capture_stage("capture:" + label_value(name)),
+      encoder_stage("encoder:" + label_value(name)),
+      decoder_stage("decoder:" + label_value(name)),
+      framer_(stream_id, &pcm_queue,
+              metrics_stage(capture_stage.c_str(), this)) {
+  std::string labels = "{device=\"" + label_value(name) + "\"}";
+  metrics_gauge("pcm_queue_depth", labels,
+                [this] { return pcm_queue.size(); }, this);
+  metrics_gauge("codec2_queue_depth", labels,
+                [this] { return codec2_queue.size(); }, this);
+
+  encoder_worker = std::thread([this] {
+    thread_profile_apply(ThreadStage::Encoder);
+
+    EncoderStage stage(&pcm_queue, &codec2_queue,
+                       metrics_stage(encoder_stage.c_str(), this));
+    stage.run();
+    stage.report();
+
+    std::cout << "encoder_worker " << name_ << " Finished" << std::endl;
+    std::cout << "Closing codec2_queue" << std::endl;
+
+    codec2_queue.close();
+  });
+
+#ifdef DECODER_DEBUGGER
+  pipeline_executor().spawn(decoder_debugger());
+#endif
+}
+
+DevicePipeline::~DevicePipeline() {
+  close();
+
+  // The gauges and stage names point into this pipeline
+  metrics_unregister(this);
+}
+
+void DevicePipeline::close() {
+  if (!encoder_worker.joinable())
+    return;
+
+  pcm_queue.close();
+
+  std::cout << "Wait for encoder_worker " << name_ << std::endl;
+  encoder_worker.join();
+
+#ifdef DECODER_DEBUGGER
+  std::cout << "Wait for decoder_debugger " << name_ << std::endl;
+  decoder_done.acquire();
+#endif
+
+  framer_.report();
+}
+
+#ifdef DECODER_DEBUGGER
+// Decodes what the encoder produced back into recording-<stream>.wav
+Task DevicePipeline::decoder_debugger() {
+  // Scoped so the WAV file is complete before close() returns
+  {
+    Encoder decoder(false);
+    JitterMeter jitter(metrics_stage(decoder_stage.c_str(), this));
+    WavFile wav_file =
+        WavFile("recording-" + std::to_string(this->stream_id) + ".wav");
+    ComfortNoise comfort_noise;
+    uint32_t session_id = UINT32_MAX;
+    uint32_t next_piece_id = 0;
+    // The last frame was a SID, so a gap after it is DTX and not a drop
+    bool in_silence = false;
+
+    while (auto maybe_data = co_await codec2_queue.async_recv()) {
+      Codec2Data data = std::move(*maybe_data);
+
+      jitter.wake(data.piece_id * FRAME_PERIOD_NS,
+                  data.session_id != session_id);
+
+      // Frames suppressed by DTX leave gaps in piece_id, fill them with
+      // noise. Gaps after voice are queue drops and stay gaps.
+      if (data.session_id == session_id) {
+        while (in_silence && next_piece_id < data.piece_id)
+          wav_file.write_pcm(comfort_noise.generate(
+              data.stream_id, session_id, next_piece_id++));
+      } else {
+        session_id = data.session_id;
+        comfort_noise.set_level(0);
+      }
+      next_piece_id = data.piece_id + 1;
+      in_silence = data.type == FrameType::Sid;
+
+      if (data.type == FrameType::Sid) {
+        comfort_noise.set_level(data.bytes[0]);
+        wav_file.write_pcm(comfort_noise.generate(
+            data.stream_id, data.session_id, data.piece_id));
+        continue;
+      }
+
+      PcmData pcm_data = decoder.decode(data);
+
+      wav_file.write_pcm(pcm_data);
+    }
+
+    jitter.report("decoder");
+  }
+
+  decoder_done.release();
+}
+#endif
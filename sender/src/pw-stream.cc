@@ -8,41 +8,66 @@
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <functional>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <set>
+#include <string>
 
 #include "MsgQueue.h"
+#include "capture_trace.h"
+#include "config.h"
 #include "data.h"
+#include "metrics.h"
+#include "pcm_framer.h"
 #include "pw-stream.h"
+#include "thread_profile.h"
+#include "trace.h"
 
-#define PW_STREAM_DEBUG 1
+// Tap every captured frame into pw-stream-debug-<stream>.wav. The writes
+// block inside the real-time process callback, debug builds only.
+// #define PW_STREAM_DEBUG 1
+
+// Delay before re-creating a stream that failed while its node is present
+#define RECONNECT_RETRY_MS 100
 
 #ifdef PW_STREAM_DEBUG
 #include "wav_file.h"
 #endif
 
-class PwStreamImpl {
+// One capture stream linked to a single source node. All of them are
+// created on the same context, so their process callbacks share its data
+// loop.
+class NodeCapture {
 public:
-  PwStreamImpl(MsgQueue<PcmData> *pcm_queue) : pcm_queue(pcm_queue) {
-    pw_init(nullptr, nullptr);
-
-    loop = pw_main_loop_new(nullptr);
-    if (!loop) {
-      throw std::runtime_error("Failed to create PipeWire main loop");
-    }
-
-    // Register signal handlers
-    pw_loop_add_signal(pw_main_loop_get_loop(loop), SIGINT,
-                       &PwStreamImpl::do_quit, this);
-    pw_loop_add_signal(pw_main_loop_get_loop(loop), SIGTERM,
-                       &PwStreamImpl::do_quit, this);
-
+  // lost_ns is when the device's previous stream went away, 0 for a first
+  // connection. on_lost runs on the main loop when this stream fails,
+  // on_streaming when it starts streaming. recorder, when set, logs every
+  // callback before it is framed.
+  NodeCapture(struct pw_core *core, uint32_t node_id, const char *serial,
+              uint32_t stream_id, PcmFramer *framer, uint64_t lost_ns,
+              CaptureRecorder *recorder,
+              std::function<void(uint32_t)> on_lost,
+              std::function<void()> on_streaming)
+      : node_id(node_id), stream_id(stream_id), framer(framer),
+        recorder(recorder), lost_ns(lost_ns), on_lost(std::move(on_lost)),
+        on_streaming(std::move(on_streaming)) {
     auto *props =
         pw_properties_new(PW_KEY_MEDIA_TYPE, "Audio", PW_KEY_MEDIA_CATEGORY,
                           "Capture", PW_KEY_MEDIA_ROLE, "Music", nullptr);
+    // Stay on this node instead of falling back to the default source
+    pw_properties_set(props, "node.dont-reconnect", "true");
+    if (serial)
+      pw_properties_set(props, PW_KEY_TARGET_OBJECT, serial);
+
+    std::string name = "audio-capture-" + std::to_string(stream_id);
+    stream = pw_stream_new(core, name.c_str(), props);
+    if (!stream) {
+      throw std::runtime_error("Failed to create PipeWire stream");
+    }
 
-    stream = pw_stream_new_simple(pw_main_loop_get_loop(loop), "audio-capture",
-                                  props, &stream_events, this);
+    pw_stream_add_listener(stream, &stream_listener, &stream_events, this);
 
     uint8_t buffer[1024];
     spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
@@ -56,108 +81,74 @@ public:
     params[0] =
         spa_format_audio_raw_build(&b, SPA_PARAM_EnumFormat, &audio_info_raw);
 
-    pw_stream_connect(stream, PW_DIRECTION_INPUT, PW_ID_ANY,
+    pw_stream_connect(stream, PW_DIRECTION_INPUT, serial ? PW_ID_ANY : node_id,
                       static_cast<pw_stream_flags>(PW_STREAM_FLAG_AUTOCONNECT |
                                                    PW_STREAM_FLAG_MAP_BUFFERS |
                                                    PW_STREAM_FLAG_RT_PROCESS),
                       params, 1);
 
 #ifdef PW_STREAM_DEBUG
-    wav_file = new WavFile("pw-stream-debug.wav");
+    wav_file = new WavFile("pw-stream-debug-" + std::to_string(stream_id) +
+                           ".wav");
+    framer->set_debug_tap(wav_file);
 #endif
   }
 
-  ~PwStreamImpl() {
+  ~NodeCapture() {
+    // No state_changed callbacks for our own teardown
+    spa_hook_remove(&stream_listener);
+
+    // Synchronizes with the data loop, on_process is not running afterwards
     if (stream)
       pw_stream_destroy(stream);
-    if (loop)
-      pw_main_loop_destroy(loop);
-    pw_deinit();
 
 #ifdef PW_STREAM_DEBUG
+    framer->set_debug_tap(nullptr);
     delete wav_file;
 #endif
   }
 
-  void run() { pw_main_loop_run(loop); }
-
-  void reset_session() {
-    this->new_session = true;
-
-    this->pcm_data.session_id += 1;
-    this->pcm_data.piece_id = 0;
-    this->pcm_data.samples_n = 0;
-
-    this->zero_samples = 0;
-  }
-
-  void send_data(int16_t *samples, uint32_t n_samples) {
-    while (n_samples != 0) {
-      uint32_t copy_amount = PCM_SAMPLE_MAX - this->pcm_data.samples_n;
-
-      if (copy_amount > n_samples)
-        copy_amount = n_samples;
-
-      memcpy(&this->pcm_data.samples[this->pcm_data.samples_n], samples,
-             copy_amount * sizeof(int16_t));
-
-      n_samples -= copy_amount;
-      samples += copy_amount;
-
-      this->pcm_data.samples_n += copy_amount;
-
-      if (this->pcm_data.samples_n == PCM_SAMPLE_MAX)
-        this->emit_pcm_data();
-    }
-  }
-
-  void emit_pcm_data() {
-    // std::cout << "emit_pcm_data " << this->pcm_data.session_id << "."
-    //           << this->pcm_data.piece_id << std::endl;
-
-    this->pcm_queue->send(this->pcm_data);
-
-#ifdef PW_STREAM_DEBUG
-    this->wav_file->write_pcm(this->pcm_data);
-#endif
-
-    this->pcm_data.piece_id += 1;
-    this->pcm_data.samples_n = 0;
-  }
-
 private:
-  struct pw_main_loop *loop = nullptr;
+  uint32_t node_id;
+  uint32_t stream_id;
   struct pw_stream *stream = nullptr;
+  struct spa_hook stream_listener = {};
   struct spa_audio_info format = {};
 
-  MsgQueue<PcmData> *pcm_queue;
-
-  PcmData pcm_data = {0};
-
-  uint64_t zero_samples = 0;
+  PcmFramer *framer;
+  CaptureRecorder *recorder;
 
-  bool new_session = true;
+  // Cleared by on_process once audio flows again
+  uint64_t lost_ns;
+  std::function<void(uint32_t)> on_lost;
+  std::function<void()> on_streaming;
 
 #ifdef PW_STREAM_DEBUG
   WavFile *wav_file;
 #endif
 
-  static void do_quit(void *data, int) {
-
-    auto *ctx = static_cast<PwStreamImpl *>(data);
-
-    ctx->pcm_queue->close();
-
-    std::cout << "Closed pcm_queue" << std::endl;
-
-    pw_main_loop_quit(ctx->loop);
-
-    std::cout << "PwStream Do Quit Processed" << std::endl;
+  static void on_state_changed(void *data, enum pw_stream_state old,
+                               enum pw_stream_state state, const char *error) {
+    auto *ctx = static_cast<NodeCapture *>(data);
+
+    std::cout << "node " << ctx->node_id << " stream "
+              << pw_stream_state_as_string(old) << " -> "
+              << pw_stream_state_as_string(state);
+    if (error)
+      std::cout << " (" << error << ")";
+    std::cout << std::endl;
+
+    if (state == PW_STREAM_STATE_ERROR ||
+        (state == PW_STREAM_STATE_UNCONNECTED &&
+         old != PW_STREAM_STATE_UNCONNECTED))
+      ctx->on_lost(ctx->node_id);
+    else if (state == PW_STREAM_STATE_STREAMING)
+      ctx->on_streaming();
   }
 
   static void on_stream_param_changed(void *data, uint32_t id,
                                       const struct spa_pod *param) {
-    auto *ctx = static_cast<PwStreamImpl *>(data);
+    auto *ctx = static_cast<NodeCapture *>(data);
 
     if (param == nullptr || id != SPA_PARAM_Format)
       return;
@@ -173,16 +164,22 @@ private:
 
     spa_format_audio_raw_parse(param, &ctx->format.info.raw);
 
-    std::cout << "capturing rate:" << ctx->format.info.raw.rate
+    std::cout << "node " << ctx->node_id
+              << " capturing rate:" << ctx->format.info.raw.rate
               << " channels:" << ctx->format.info.raw.channels << "\n";
   }
 
   static void on_process(void *data) {
-    auto *ctx = static_cast<PwStreamImpl *>(data);
+    TRACE_SCOPE("PwStreamImpl::on_process");
+
+    auto *ctx = static_cast<NodeCapture *>(data);
+    StageMetrics *metrics = ctx->framer->stage_metrics();
+    uint64_t start_ns = metrics_now_ns();
 
     struct pw_buffer *b = pw_stream_dequeue_buffer(ctx->stream);
     if (!b) {
       pw_log_warn("out of buffers: %m");
+      metrics->add(Counter::PwXruns);
       return;
     }
 
@@ -206,57 +203,38 @@ private:
 
     // std::cout << "peak:" << max << "\n" << std::flush;
 
-    /////// Actual process
-
-    // Session change check: more than 1 sec of silence
-    // New session, only start sending if non zero data comes in
-    // Always starts with the first non zero sample
-
-    // Whenever PCM_SAMPLE_MAX samples are collected, send an object on the
-    // queue Signal via conditional variable
-
-    // Make a wrapper for the queue with conditonal variables and sample
-
-    uint32_t idx_first_nonzero = 0;
-
-    while (idx_first_nonzero < n_samples) {
-      if (samples[idx_first_nonzero] != 0)
-        break;
-      ++idx_first_nonzero;
+    if (ctx->lost_ns && n_samples) {
+      metrics->add(Counter::Reconnects);
+      metrics->observe(Histogram::Reconnect, start_ns - ctx->lost_ns);
+      ctx->lost_ns = 0;
     }
 
-    if (ctx->new_session) {
-      if (idx_first_nonzero != n_samples) {
-        ctx->new_session = false;
-
-        ctx->send_data(&samples[idx_first_nonzero],
-                       n_samples - idx_first_nonzero);
-      }
-    } else {
-      ctx->send_data(samples, n_samples);
+    // How long the oldest of these samples took from the device, through
+    // the graph and our stream's converter
+    struct pw_time time;
+    if (pw_stream_get_time_n(ctx->stream, &time, sizeof(time)) == 0 &&
+        time.rate.denom && time.delay >= 0)
+      metrics->observe(Histogram::CaptureLatency,
+                       time.delay * SPA_NSEC_PER_SEC * time.rate.num /
+                               time.rate.denom +
+                           time.buffered * SPA_NSEC_PER_SEC / 8000);
 
-      if (idx_first_nonzero == n_samples) {
-        ctx->zero_samples += n_samples;
+    if (ctx->recorder)
+      ctx->recorder->record(ctx->stream_id, start_ns, samples, n_samples);
 
-        // More than 1s of silence
-        if (ctx->zero_samples >= 8000) {
-          // Reset the session
-          ctx->reset_session();
-        }
-      } else {
-        ctx->zero_samples = 0;
-      }
-    }
+    ctx->framer->process(samples, n_samples);
 
     pw_stream_queue_buffer(ctx->stream, b);
+
+    metrics->observe(Histogram::CaptureCallback, metrics_now_ns() - start_ns);
   }
 
   static constexpr pw_stream_events stream_events = {
       .version = PW_VERSION_STREAM_EVENTS,
-      .param_changed = &PwStreamImpl::on_stream_param_changed,
-      .process = &PwStreamImpl::on_process,
+      .state_changed = &NodeCapture::on_state_changed,
+      .param_changed = &NodeCapture::on_stream_param_changed,
+      .process = &NodeCapture::on_process,
       // .destroy = nullptr,
-      // .state_changed = nullptr,
       // .control_info = nullptr,
       // .io_changed = nullptr,
       // .add_buffer = nullptr,
@@ -267,6 +245,415 @@ private:
   };
 };
 
+// Watches the registry and opens a NodeCapture for every matching source.
+// Devices outlive their nodes: when a source comes back its new stream
+// feeds the same framer, queues and encoder as before.
+class PwStreamImpl {
+public:
+  PwStreamImpl(PwStream::OpenDevice open_device,
+               PwStream::CloseDevice close_device)
+      : open_device(std::move(open_device)),
+        close_device(std::move(close_device)) {
+    pw_init(nullptr, nullptr);
+
+#ifdef CAPTURE_RECORD
+    recorder = std::make_unique<CaptureRecorder>(CAPTURE_RECORD_OUTPUT);
+#endif
+
+    loop = pw_main_loop_new(nullptr);
+    if (!loop) {
+      throw std::runtime_error("Failed to create PipeWire main loop");
+    }
+
+    // Register signal handlers
+    pw_loop_add_signal(pw_main_loop_get_loop(loop), SIGINT,
+                       &PwStreamImpl::do_quit, this);
+    pw_loop_add_signal(pw_main_loop_get_loop(loop), SIGTERM,
+                       &PwStreamImpl::do_quit, this);
+#ifdef PIPELINE_TRACE
+    pw_loop_add_signal(pw_main_loop_get_loop(loop), SIGUSR1,
+                       &PwStreamImpl::do_trace_dump, this);
+#endif
+    pw_loop_add_signal(pw_main_loop_get_loop(loop), SIGHUP,
+                       &PwStreamImpl::do_reload, this);
+
+    retry_timer = pw_loop_add_timer(pw_main_loop_get_loop(loop),
+                                    &PwStreamImpl::on_retry, this);
+    expiry_timer = pw_loop_add_timer(pw_main_loop_get_loop(loop),
+                                     &PwStreamImpl::on_expiry, this);
+
+    context = pw_context_new(pw_main_loop_get_loop(loop), nullptr, 0);
+    if (!context) {
+      throw std::runtime_error("Failed to create PipeWire context");
+    }
+
+    core = pw_context_connect(context, nullptr, 0);
+    if (!core) {
+      throw std::runtime_error("Failed to connect to PipeWire");
+    }
+
+    registry = pw_core_get_registry(core, PW_VERSION_REGISTRY, 0);
+    pw_registry_add_listener(registry, &registry_listener, &registry_events,
+                             this);
+
+    const Config *config = config_current();
+    std::cout << "Waiting for Audio/Source nodes (match=\""
+              << config->capture_match << "\" api=\""
+              << config->capture_device_api << "\")" << std::endl;
+  }
+
+  ~PwStreamImpl() {
+    nodes.clear();
+
+    if (registry)
+      pw_proxy_destroy(reinterpret_cast<struct pw_proxy *>(registry));
+    if (core)
+      pw_core_disconnect(core);
+    if (context)
+      pw_context_destroy(context);
+    if (loop)
+      pw_main_loop_destroy(loop);
+    pw_deinit();
+  }
+
+  void run() { pw_main_loop_run(loop); }
+
+private:
+  struct pw_main_loop *loop = nullptr;
+  struct pw_context *context = nullptr;
+  struct pw_core *core = nullptr;
+  struct pw_registry *registry = nullptr;
+  struct spa_hook registry_listener = {};
+  struct spa_source *retry_timer = nullptr;
+  struct spa_source *expiry_timer = nullptr;
+
+  PwStream::OpenDevice open_device;
+  PwStream::CloseDevice close_device;
+
+  // Only set with CAPTURE_RECORD, destroyed after the nodes
+  std::unique_ptr<CaptureRecorder> recorder;
+
+  struct Device {
+    uint32_t stream_id;
+    PcmFramer *framer;
+    uint64_t lost_ns = 0; // set while the device has no working stream
+    uint64_t gone_ns = 0; // set while the device has no node at all
+  };
+
+  struct NodeInfo {
+    std::string key;
+    std::string name;
+    std::string serial;
+  };
+
+  struct Node {
+    std::string device_key;
+    std::string serial;
+    std::unique_ptr<NodeCapture> capture;
+  };
+
+  uint32_t next_stream_id = 0;
+  // Keyed by a property that survives reconnects, see device_key()
+  std::map<std::string, Device> devices;
+  std::map<uint32_t, Node> nodes;
+  // Further nodes of captured devices, one takes over when the captured
+  // node goes away
+  std::map<uint32_t, Node> standby;
+  // Nodes of devices open_device() had no room for
+  std::map<uint32_t, NodeInfo> refused;
+  // Nodes whose stream failed and is waiting for on_retry
+  std::set<uint32_t> failed_nodes;
+  // The data loop thread got its placement
+  bool capture_placed = false;
+
+  static void do_quit(void *data, int) {
+    auto *ctx = static_cast<PwStreamImpl *>(data);
+
+    pw_main_loop_quit(ctx->loop);
+
+    std::cout << "PwStream Do Quit Processed" << std::endl;
+  }
+
+  // Streams already running pick the new snapshot up on their own, the
+  // capture filter applies to nodes announced from now on
+  static void do_reload(void *, int) {
+    std::string error;
+    config_reload(error);
+  }
+
+#ifdef PIPELINE_TRACE
+  static void do_trace_dump(void *, int) { trace_dump(TRACE_OUTPUT); }
+#endif
+
+  static bool matches(const struct spa_dict *props) {
+    const char *media_class = spa_dict_lookup(props, PW_KEY_MEDIA_CLASS);
+    if (!media_class || strcmp(media_class, "Audio/Source") != 0)
+      return false;
+
+    const Config *config = config_current();
+
+    if (!config->capture_device_api.empty()) {
+      const char *api = spa_dict_lookup(props, "device.api");
+      if (!api || config->capture_device_api != api)
+        return false;
+    }
+
+    if (!config->capture_match.empty()) {
+      const char *desc = spa_dict_lookup(props, PW_KEY_DEVICE_DESCRIPTION);
+      if (!desc)
+        desc = spa_dict_lookup(props, PW_KEY_NODE_DESCRIPTION);
+      if (!desc || !strstr(desc, config->capture_match.c_str()))
+        return false;
+    }
+
+    return true;
+  }
+
+  // Node ids change when a phone reconnects, its address and node name do
+  // not
+  static std::string device_key(uint32_t id, const struct spa_dict *props) {
+    for (const char *key :
+         {"api.bluez5.address", PW_KEY_NODE_NAME, PW_KEY_DEVICE_DESCRIPTION}) {
+      if (const char *value = spa_dict_lookup(props, key))
+        return value;
+    }
+    return "node-" + std::to_string(id);
+  }
+
+  void connect_node(uint32_t id) {
+    Node &node = nodes.at(id);
+    Device &device = devices.at(node.device_key);
+
+    try {
+      node.capture = std::make_unique<NodeCapture>(
+          core, id, node.serial.empty() ? nullptr : node.serial.c_str(),
+          device.stream_id, device.framer, device.lost_ns, recorder.get(),
+          [this](uint32_t node_id) { on_stream_lost(node_id); },
+          [this] { place_capture_thread(); });
+      device.lost_ns = 0;
+    } catch (const std::exception &ex) {
+      std::cerr << "Error: node " << id << ": " << ex.what() << "\n";
+      // Tried again like a stream that failed after connecting
+      on_stream_lost(id);
+    }
+  }
+
+  // Stops feeding a device, keeping everything downstream alive
+  void disconnect_node(Node &node) {
+    if (!node.capture)
+      return;
+
+    node.capture.reset();
+
+    Device &device = devices.at(node.device_key);
+    device.framer->interrupt();
+    if (!device.lost_ns)
+      device.lost_ns = metrics_now_ns();
+  }
+
+  // All streams process on the context's data loop. Its thread runs by the
+  // time a stream streams, the placement is applied there once, outside any
+  // process callback, which must not make syscalls.
+  void place_capture_thread() {
+    if (capture_placed)
+      return;
+    capture_placed = true;
+
+    struct pw_loop *data_loop =
+        pw_data_loop_get_loop(pw_context_get_data_loop(context));
+    pw_loop_invoke(data_loop, &PwStreamImpl::do_place_capture, 0, nullptr, 0,
+                   false, nullptr);
+  }
+
+  static int do_place_capture(struct spa_loop *, bool, uint32_t,
+                              const void *, size_t, void *) {
+    thread_profile_apply(ThreadStage::Capture);
+    return 0;
+  }
+
+  void on_stream_lost(uint32_t node_id) {
+    Device &device = devices.at(nodes.at(node_id).device_key);
+    if (!device.lost_ns)
+      device.lost_ns = metrics_now_ns();
+
+    failed_nodes.insert(node_id);
+
+    struct timespec value = {0, RECONNECT_RETRY_MS * 1000000L};
+    pw_loop_update_timer(pw_main_loop_get_loop(loop), retry_timer, &value,
+                         nullptr, false);
+  }
+
+  // Wakes up for the device that expires first, if any
+  void arm_expiry() {
+    uint64_t first = 0;
+    for (auto &[key, device] : devices)
+      if (device.gone_ns && (!first || device.gone_ns < first))
+        first = device.gone_ns;
+
+    struct timespec value = {0, 0};
+    if (first) {
+      uint64_t now = metrics_now_ns();
+      uint64_t due = first + DEVICE_EXPIRY_MS * 1000000ull;
+      // Zero would disarm the timer
+      uint64_t wait = due > now ? due - now : 1;
+      value = {static_cast<time_t>(wait / 1000000000),
+               static_cast<long>(wait % 1000000000)};
+    }
+    pw_loop_update_timer(pw_main_loop_get_loop(loop), expiry_timer, &value,
+                         nullptr, false);
+  }
+
+  static void on_expiry(void *data, uint64_t) {
+    auto *ctx = static_cast<PwStreamImpl *>(data);
+    uint64_t now = metrics_now_ns();
+
+    for (auto it = ctx->devices.begin(); it != ctx->devices.end();) {
+      Device &device = it->second;
+      if (!device.gone_ns ||
+          now - device.gone_ns < DEVICE_EXPIRY_MS * 1000000ull) {
+        ++it;
+        continue;
+      }
+
+      std::cout << "Device " << it->first << " did not return, closing stream "
+                << device.stream_id << std::endl;
+      ctx->close_device(device.stream_id);
+      it = ctx->devices.erase(it);
+    }
+
+    for (auto it = ctx->refused.begin(); it != ctx->refused.end();) {
+      if (ctx->add_node(it->first, it->second))
+        it = ctx->refused.erase(it);
+      else
+        ++it;
+    }
+
+    ctx->arm_expiry();
+  }
+
+  static void on_retry(void *data, uint64_t) {
+    auto *ctx = static_cast<PwStreamImpl *>(data);
+
+    // Nodes that fail again during this pass are queued for the next one
+    std::set<uint32_t> retry;
+    retry.swap(ctx->failed_nodes);
+
+    for (uint32_t id : retry) {
+      auto it = ctx->nodes.find(id);
+      if (it == ctx->nodes.end())
+        continue;
+
+      std::cout << "Reconnecting node " << id << std::endl;
+      ctx->disconnect_node(it->second);
+      ctx->connect_node(id);
+    }
+  }
+
+  // Captures node id for its device, opening the device if it is new.
+  // Returns false if open_device refused it.
+  bool add_node(uint32_t id, const NodeInfo &info) {
+    auto device = devices.find(info.key);
+    if (device == devices.end()) {
+      uint32_t stream_id = next_stream_id;
+      PcmFramer *framer = open_device(stream_id, info.name);
+      if (!framer)
+        return false;
+      ++next_stream_id;
+
+      device = devices.emplace(info.key, Device{stream_id, framer}).first;
+      std::cout << "Capturing node " << id << " (" << info.name
+                << ") as stream " << stream_id << std::endl;
+    } else {
+      // A framer must only ever be fed by one stream
+      for (auto &[other_id, other] : nodes)
+        if (other.device_key == info.key) {
+          std::cout << "Node " << id << " on standby, " << info.key
+                    << " is already captured from node " << other_id
+                    << std::endl;
+          standby[id] = Node{info.key, info.serial, nullptr};
+          return true;
+        }
+
+      std::cout << "Node " << id << " is " << info.key
+                << " returning, stream " << device->second.stream_id
+                << std::endl;
+      device->second.gone_ns = 0;
+    }
+
+    nodes[id] = Node{info.key, info.serial, nullptr};
+    connect_node(id);
+    return true;
+  }
+
+  static void on_global(void *data, uint32_t id, uint32_t, const char *type,
+                        uint32_t, const struct spa_dict *props) {
+    auto *ctx = static_cast<PwStreamImpl *>(data);
+
+    if (strcmp(type, PW_TYPE_INTERFACE_Node) != 0 || !props || !matches(props))
+      return;
+
+    if (ctx->nodes.count(id) || ctx->standby.count(id) ||
+        ctx->refused.count(id))
+      return;
+
+    NodeInfo info;
+    info.key = device_key(id, props);
+    const char *desc = spa_dict_lookup(props, PW_KEY_DEVICE_DESCRIPTION);
+    if (!desc)
+      desc = spa_dict_lookup(props, PW_KEY_NODE_DESCRIPTION);
+    info.name = desc ? desc : info.key;
+    const char *serial = spa_dict_lookup(props, PW_KEY_OBJECT_SERIAL);
+    info.serial = serial ? serial : "";
+
+    // Offered again when an expired device frees its place
+    if (!ctx->add_node(id, info) && ctx->close_device)
+      ctx->refused[id] = std::move(info);
+  }
+
+  static void on_global_remove(void *data, uint32_t id) {
+    auto *ctx = static_cast<PwStreamImpl *>(data);
+
+    if (ctx->standby.erase(id) || ctx->refused.erase(id))
+      return;
+
+    auto it = ctx->nodes.find(id);
+    if (it == ctx->nodes.end())
+      return;
+
+    std::string key = it->second.device_key;
+    ctx->disconnect_node(it->second);
+    ctx->nodes.erase(it);
+    ctx->failed_nodes.erase(id);
+
+    for (auto &[other_id, node] : ctx->standby) {
+      if (node.device_key != key)
+        continue;
+
+      std::cout << "Node " << id << " removed, node " << other_id
+                << " takes over " << key << std::endl;
+      uint32_t next = other_id;
+      ctx->nodes[next] = std::move(node);
+      ctx->standby.erase(next);
+      ctx->connect_node(next);
+      return;
+    }
+
+    std::cout << "Node " << id << " removed, waiting for it to return"
+              << std::endl;
+
+    if (ctx->close_device) {
+      ctx->devices.at(key).gone_ns = metrics_now_ns();
+      ctx->arm_expiry();
+    }
+  }
+
+  static constexpr pw_registry_events registry_events = {
+      .version = PW_VERSION_REGISTRY_EVENTS,
+      .global = &PwStreamImpl::on_global,
+      .global_remove = &PwStreamImpl::on_global_remove,
+  };
+};
+
 // int main() {
 //   try {
 //     Context ctx;
@@ -279,8 +666,9 @@ private:
 //   return EXIT_SUCCESS;
 // }
 
-PwStream::PwStream(MsgQueue<PcmData> *pcm_queue)
-    : impl_(std::make_unique<PwStreamImpl>(pcm_queue)) {}
+PwStream::PwStream(OpenDevice open_device, CloseDevice close_device)
+    : impl_(std::make_unique<PwStreamImpl>(std::move(open_device),
+                                           std::move(close_device))) {}
 
 PwStream::~PwStream() = default;
 
@@ -0,0 +1,335 @@
+#include "relay.h"
+#include "packet.h"
+
+#include <linux/filter.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+// Relaxed single-writer counter, as in StageMetrics
+static void bump(std::atomic<uint64_t> &v, uint64_t n = 1) {
+  v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+class RelayShard {
+public:
+  RelayShard(uint32_t index, int fd, const RelayConfig &config)
+      : index(index), fd(fd), subscribers(config.subscribers) {
+    if (!config.archive_prefix.empty()) {
+      archive.open(config.archive_prefix + "-" + std::to_string(index) +
+                       ".bin",
+                   std::ios::binary | std::ios::app);
+      if (!archive)
+        throw std::runtime_error("Failed to open relay archive");
+    }
+
+    worker = std::thread([this] { run(); });
+  }
+
+  ~RelayShard() {
+    running = false;
+    worker.join();
+    close(fd);
+  }
+
+  void add_to(RelayStats &stats) const {
+    stats.packets_in += packets_in.load(std::memory_order_relaxed);
+    stats.packets_out += packets_out.load(std::memory_order_relaxed);
+    stats.malformed += malformed.load(std::memory_order_relaxed);
+    stats.streams += streams_n.load(std::memory_order_relaxed);
+    stats.evicted += evicted.load(std::memory_order_relaxed);
+    stats.sessions += sessions.load(std::memory_order_relaxed);
+    stats.gaps += gaps.load(std::memory_order_relaxed);
+    stats.unrouted += unrouted.load(std::memory_order_relaxed);
+    stats.latency_ns += latency_ns.load(std::memory_order_relaxed);
+    uint64_t max = latency_max_ns.load(std::memory_order_relaxed);
+    if (max > stats.latency_max_ns)
+      stats.latency_max_ns = max;
+  }
+
+private:
+  struct Stream {
+    uint32_t session_id;
+    uint32_t next_piece;
+    uint32_t routes; // bit i set forwards to subscriber i
+    uint64_t last_ns;
+  };
+
+  static bool matches(uint32_t filter, uint32_t id) {
+    return filter == RELAY_ANY || filter == id;
+  }
+
+  // Subscribers of the packet's sender, stream and session
+  uint32_t route(const Packet &packet) const {
+    uint32_t routes = 0;
+    for (size_t i = 0; i < subscribers.size(); ++i) {
+      const RelaySubscriber &subscriber = subscribers[i];
+      if (matches(subscriber.sender_id, packet.sender_id) &&
+          matches(subscriber.stream_id, packet.data.stream_id) &&
+          matches(subscriber.session_id, packet.data.session_id))
+        routes |= 1u << i;
+    }
+    return routes;
+  }
+
+  // Tracks sessions and missing pieces of the packet's stream. Routes are
+  // worked out once per session, not per packet.
+  const Stream &demux(const Packet &packet, uint64_t received_ns) {
+    uint64_t key =
+        static_cast<uint64_t>(packet.sender_id) << 32 | packet.data.stream_id;
+    auto [it, inserted] = streams.try_emplace(
+        key, Stream{packet.data.session_id, packet.data.piece_id,
+                    route(packet), received_ns});
+    Stream &stream = it->second;
+
+    if (inserted) {
+      bump(streams_n);
+      bump(sessions);
+    } else if (packet.data.session_id != stream.session_id) {
+      bump(sessions);
+      stream.session_id = packet.data.session_id;
+      stream.next_piece = packet.data.piece_id;
+      stream.routes = route(packet);
+    } else if (packet.data.piece_id > stream.next_piece) {
+      // DTX leaves gaps too, they count the same
+      bump(gaps, packet.data.piece_id - stream.next_piece);
+    }
+
+    if (packet.data.piece_id >= stream.next_piece)
+      stream.next_piece = packet.data.piece_id + 1;
+    stream.last_ns = received_ns;
+
+    return stream;
+  }
+
+  // Forgets the streams idle for RELAY_STREAM_IDLE_MS, a sender that went
+  // away must not hold its entries for the life of the relay
+  void evict(uint64_t now_ns) {
+    uint64_t idle_ns = RELAY_STREAM_IDLE_MS * 1000000ull;
+    size_t n = std::erase_if(streams, [&](const auto &entry) {
+      return entry.second.last_ns + idle_ns < now_ns;
+    });
+    bump(evicted, n);
+    evicted_ns = now_ns;
+  }
+
+  void run() {
+    // Shard i serves the streams the selector maps to i, keep it on CPU i
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus > 0) {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(index % cpus, &set);
+      pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+
+    std::vector<uint8_t> bufs(RELAY_BATCH * (PACKET_SIZE_MAX + 1));
+    std::vector<iovec> in_iov(RELAY_BATCH);
+    std::vector<mmsghdr> in_msgs(RELAY_BATCH);
+    for (uint32_t i = 0; i < RELAY_BATCH; ++i) {
+      in_iov[i] = {&bufs[i * (PACKET_SIZE_MAX + 1)], PACKET_SIZE_MAX + 1};
+      in_msgs[i].msg_hdr = {};
+      in_msgs[i].msg_hdr.msg_iov = &in_iov[i];
+      in_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    size_t out_max = RELAY_BATCH * subscribers.size();
+    std::vector<iovec> out_iov(out_max);
+    std::vector<mmsghdr> out_msgs(out_max);
+
+    while (running) {
+      // A quarter of the idle time, whether packets come or not
+      uint64_t now_ns = packet_now_ns();
+      if (now_ns - evicted_ns >= RELAY_STREAM_IDLE_MS * 1000000ull / 4)
+        evict(now_ns);
+
+      // Blocks for the first datagram, then takes whatever else is queued
+      int n = recvmmsg(fd, in_msgs.data(), RELAY_BATCH, MSG_WAITFORONE,
+                       nullptr);
+      if (n < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+          continue;
+        std::cerr << "relay: shard " << index
+                  << " receive failed: " << strerror(errno) << std::endl;
+        break;
+      }
+
+      uint64_t received_ns = packet_now_ns();
+      bump(packets_in, n);
+
+      size_t out_n = 0;
+      for (int i = 0; i < n; ++i) {
+        const uint8_t *buf = static_cast<uint8_t *>(in_iov[i].iov_base);
+        size_t len = in_msgs[i].msg_len;
+
+        Packet packet;
+        if (!packet_decode(buf, len, packet)) {
+          bump(malformed);
+          continue;
+        }
+        const Stream &stream = demux(packet, received_ns);
+        if (!stream.routes)
+          bump(unrouted);
+
+        for (uint32_t routes = stream.routes; routes; routes &= routes - 1) {
+          const sockaddr_in &subscriber =
+              subscribers[std::countr_zero(routes)].address;
+          out_iov[out_n] = {const_cast<uint8_t *>(buf), len};
+          out_msgs[out_n].msg_hdr = {};
+          out_msgs[out_n].msg_hdr.msg_name =
+              const_cast<sockaddr_in *>(&subscriber);
+          out_msgs[out_n].msg_hdr.msg_namelen = sizeof(subscriber);
+          out_msgs[out_n].msg_hdr.msg_iov = &out_iov[out_n];
+          out_msgs[out_n].msg_hdr.msg_iovlen = 1;
+          ++out_n;
+        }
+
+        // The archive keeps every packet, routed or not
+        if (archive.is_open()) {
+          uint16_t size = len;
+          archive.write(reinterpret_cast<const char *>(&received_ns),
+                        sizeof(received_ns));
+          archive.write(reinterpret_cast<const char *>(&size), sizeof(size));
+          archive.write(reinterpret_cast<const char *>(buf), len);
+        }
+      }
+
+      // A full socket buffer or an unreachable subscriber drops the rest
+      size_t sent = 0;
+      while (sent < out_n) {
+        int m = sendmmsg(fd, &out_msgs[sent], out_n - sent, 0);
+        if (m <= 0)
+          break;
+        sent += m;
+      }
+      bump(packets_out, sent);
+
+      uint64_t forwarded_ns = packet_now_ns() - received_ns;
+      bump(latency_ns, forwarded_ns * n);
+      if (forwarded_ns > latency_max_ns.load(std::memory_order_relaxed))
+        latency_max_ns.store(forwarded_ns, std::memory_order_relaxed);
+    }
+  }
+
+  uint32_t index;
+  int fd;
+  std::vector<RelaySubscriber> subscribers;
+  std::ofstream archive;
+
+  // Shard thread only
+  std::unordered_map<uint64_t, Stream> streams;
+  uint64_t evicted_ns = 0;
+
+  std::atomic<bool> running = true;
+  std::thread worker;
+
+  alignas(64) std::atomic<uint64_t> packets_in = 0;
+  std::atomic<uint64_t> packets_out = 0;
+  std::atomic<uint64_t> malformed = 0;
+  std::atomic<uint64_t> streams_n = 0;
+  std::atomic<uint64_t> evicted = 0;
+  std::atomic<uint64_t> sessions = 0;
+  std::atomic<uint64_t> gaps = 0;
+  std::atomic<uint64_t> unrouted = 0;
+  std::atomic<uint64_t> latency_ns = 0;
+  std::atomic<uint64_t> latency_max_ns = 0;
+};
+
+static int open_shard_socket(uint16_t port) {
+  int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    throw std::runtime_error("Failed to create relay socket");
+
+  int one = 1;
+  int rcvbuf = 4 * 1024 * 1024;
+  timeval timeout = {0, RELAY_POLL_MS * 1000};
+  setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+    close(fd);
+    throw std::runtime_error("Failed to bind relay port " +
+                             std::to_string(port) + ": " + strerror(errno));
+  }
+
+  return fd;
+}
+
+// Picks the shard from the packet's sender and stream id instead of the
+// address tuple, so one sender's streams spread over all shards. Socket i
+// of the group is shard i. Datagrams too short to hold the ids go to
+// shard 0.
+static bool attach_shard_selector(int fd, uint32_t shards) {
+  sock_filter code[] = {
+      {BPF_LD | BPF_W | BPF_ABS, 0, 0, PACKET_SENDER_ID_OFFSET},
+      {BPF_MISC | BPF_TAX, 0, 0, 0},
+      {BPF_LD | BPF_W | BPF_ABS, 0, 0, PACKET_STREAM_ID_OFFSET},
+      {BPF_ALU | BPF_XOR | BPF_X, 0, 0, 0},
+      {BPF_ALU | BPF_MOD | BPF_K, 0, 0, shards},
+      {BPF_RET | BPF_A, 0, 0, 0},
+  };
+  sock_fprog prog = {static_cast<unsigned short>(std::size(code)), code};
+
+  return setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog,
+                    sizeof(prog)) == 0;
+}
+
+static_assert(RELAY_SUBSCRIBERS_MAX <= 32, "routes are a 32 bit mask");
+
+Relay::Relay(const RelayConfig &config) {
+  if (config.subscribers.size() > RELAY_SUBSCRIBERS_MAX)
+    throw std::runtime_error("Too many relay subscribers");
+
+  uint32_t n = config.shards;
+  if (n == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    n = cpus > 0 ? cpus : 1;
+  }
+
+  // All sockets join the group before any shard starts reading
+  std::vector<int> fds;
+  try {
+    for (uint32_t i = 0; i < n; ++i)
+      fds.push_back(open_shard_socket(config.port));
+  } catch (...) {
+    for (int fd : fds)
+      close(fd);
+    throw;
+  }
+
+  if (n > 1 && !attach_shard_selector(fds[0], n))
+    std::cerr << "relay: cannot attach the stream shard selector: "
+              << strerror(errno) << ", sharding by sender address"
+              << std::endl;
+
+  for (uint32_t i = 0; i < n; ++i)
+    shards_.push_back(std::make_unique<RelayShard>(i, fds[i], config));
+
+  std::cout << "relay: listening on port " << config.port << " with " << n
+            << " shards, " << config.subscribers.size() << " subscribers"
+            << std::endl;
+}
+
+Relay::~Relay() = default;
+
+RelayStats Relay::stats() const {
+  RelayStats stats;
+  for (auto &shard : shards_)
+    shard->add_to(stats);
+  return stats;
+}
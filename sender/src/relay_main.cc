@@ -0,0 +1,129 @@
+#include "relay.h"
+
+#include <arpa/inet.h>
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#define RELAY_STATS_INTERVAL_MS 1000
+
+static std::atomic<bool> quit = false;
+
+static void quit_handler(int) { quit = true; }
+
+static bool parse_address(const std::string &text, sockaddr_in &addr) {
+  size_t colon = text.rfind(':');
+  if (colon == std::string::npos)
+    return false;
+
+  addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(atoi(text.c_str() + colon + 1));
+  return inet_pton(AF_INET, text.substr(0, colon).c_str(), &addr.sin_addr) ==
+             1 &&
+         addr.sin_port != 0;
+}
+
+// ADDR:PORT[/SENDER[/STREAM[/SESSION]]], an id left out or * matches any
+static bool parse_subscriber(const std::string &text,
+                             RelaySubscriber &subscriber) {
+  subscriber = {};
+  size_t slash = text.find('/');
+  if (!parse_address(text.substr(0, slash), subscriber.address))
+    return false;
+
+  uint32_t *ids[] = {&subscriber.sender_id, &subscriber.stream_id,
+                     &subscriber.session_id};
+  for (uint32_t *id : ids) {
+    if (slash == std::string::npos)
+      break;
+    size_t next = text.find('/', slash + 1);
+    std::string field = text.substr(slash + 1, next - slash - 1);
+    if (field.empty() ||
+        (field != "*" &&
+         field.find_first_not_of("0123456789") != std::string::npos))
+      return false;
+    if (field != "*")
+      *id = strtoul(field.c_str(), nullptr, 10);
+    slash = next;
+  }
+
+  return slash == std::string::npos;
+}
+
+static void usage() {
+  std::cerr << "usage: relay [--port N] [--shards N] "
+               "[--subscribe ADDR:PORT[/SENDER[/STREAM[/SESSION]]]]... "
+               "[--archive PREFIX]"
+            << std::endl;
+}
+
+int main(int argc, char **argv) {
+  RelayConfig config;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (i + 1 == argc) {
+      usage();
+      return EXIT_FAILURE;
+    }
+
+    const char *value = argv[++i];
+    RelaySubscriber subscriber;
+    if (arg == "--port") {
+      config.port = atoi(value);
+    } else if (arg == "--shards") {
+      config.shards = atoi(value);
+    } else if (arg == "--subscribe" && parse_subscriber(value, subscriber)) {
+      config.subscribers.push_back(subscriber);
+    } else if (arg == "--archive") {
+      config.archive_prefix = value;
+    } else {
+      usage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  struct sigaction sa{};
+  sa.sa_handler = quit_handler;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, nullptr);
+  sigaction(SIGTERM, &sa, nullptr);
+
+  try {
+    Relay relay(config);
+    RelayStats last;
+
+    while (!quit) {
+      std::this_thread::sleep_for(
+          std::chrono::milliseconds(RELAY_STATS_INTERVAL_MS));
+
+      RelayStats now = relay.stats();
+      uint64_t in = now.packets_in - last.packets_in;
+      uint64_t out = now.packets_out - last.packets_out;
+      double avg_us =
+          in ? (now.latency_ns - last.latency_ns) / 1000.0 / in : 0.0;
+
+      std::cout << "relay: in=" << in * 1000 / RELAY_STATS_INTERVAL_MS
+                << "/s out=" << out * 1000 / RELAY_STATS_INTERVAL_MS
+                << "/s streams=" << now.streams - now.evicted
+                << " sessions=" << now.sessions << " gaps=" << now.gaps
+                << " unrouted=" << now.unrouted
+                << " malformed=" << now.malformed << " latency avg=" << avg_us
+                << "us max=" << now.latency_max_ns / 1000.0 << "us"
+                << std::endl;
+      last = now;
+    }
+  } catch (const std::exception &ex) {
+    std::cerr << "Error: " << ex.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,90 @@
+#include "resampler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+Resampler::Resampler(uint32_t in_rate, uint32_t out_rate) : in_rate_(in_rate) {
+  uint32_t g = std::gcd(in_rate, out_rate);
+  up = out_rate / g;
+  down = in_rate / g;
+
+  // Band edges relative to the input rate, Blackman needs ~5.5 / width taps
+  double base = std::min(in_rate, out_rate);
+  double pass = 0.425 * base / in_rate;
+  double stop = 0.5 * base / in_rate;
+  taps = static_cast<uint32_t>(std::ceil(5.5 / (stop - pass)));
+
+  // Prototype at the upsampled rate, gain up to make up for the zeros
+  size_t n = static_cast<size_t>(taps) * up;
+  double fc = (pass + stop) / 2 / up;
+  std::vector<double> h(n);
+  double sum = 0;
+  for (size_t i = 0; i < n; ++i) {
+    double x = i - (n - 1) / 2.0;
+    double sinc =
+        x == 0 ? 1.0 : std::sin(2 * M_PI * fc * x) / (2 * M_PI * fc * x);
+    double w = 0.42 - 0.5 * std::cos(2 * M_PI * i / (n - 1)) +
+               0.08 * std::cos(4 * M_PI * i / (n - 1));
+    h[i] = 2 * fc * sinc * w;
+    sum += h[i];
+  }
+
+  coefs.resize(n);
+  for (uint32_t p = 0; p < up; ++p)
+    for (uint32_t j = 0; j < taps; ++j)
+      coefs[p * taps + (taps - 1 - j)] =
+          static_cast<float>(h[p + j * up] * up / sum);
+
+  buf.assign(taps - 1 + RESAMPLER_CHUNK, 0.0f);
+  pos = taps - 1;
+}
+
+size_t Resampler::process(const int16_t *in, size_t n, int16_t *out,
+                          size_t out_max) {
+  size_t written = 0;
+
+  while (n != 0) {
+    size_t chunk = std::min<size_t>(n, RESAMPLER_CHUNK);
+    for (size_t i = 0; i < chunk; ++i)
+      buf[taps - 1 + i] = in[i];
+    size_t end = taps - 1 + chunk;
+
+    while (pos < end) {
+      // Four sums keep the adds independent
+      const float *x = &buf[pos + 1 - taps];
+      const float *c = &coefs[static_cast<size_t>(phase) * taps];
+      float acc[4] = {0, 0, 0, 0};
+      uint32_t i = 0;
+      for (; i + 4 <= taps; i += 4)
+        for (uint32_t k = 0; k < 4; ++k)
+          acc[k] += c[i + k] * x[i + k];
+      for (; i < taps; ++i)
+        acc[0] += c[i] * x[i];
+
+      // Output beyond out_max is dropped, the caller sized it wrong
+      float y = (acc[0] + acc[1]) + (acc[2] + acc[3]);
+      assert(written < out_max);
+      if (written < out_max)
+        out[written++] = static_cast<int16_t>(
+            std::clamp(std::lround(y), -32768L, 32767L));
+
+      phase += down;
+      pos += phase / up;
+      phase %= up;
+    }
+
+    pos -= chunk;
+    memmove(buf.data(), buf.data() + chunk, (taps - 1) * sizeof(float));
+    in += chunk;
+    n -= chunk;
+  }
+
+  return written;
+}
+
+double Resampler::delay_ms() const {
+  return (static_cast<double>(taps) * up - 1) / 2 / (in_rate_ * up) * 1000;
+}
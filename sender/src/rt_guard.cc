@@ -0,0 +1,249 @@
+#include "rt_guard.h"
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <poll.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/select.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cstdarg>
+#include <cstddef>
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *ptr);
+}
+
+static thread_local int rt_depth = 0;
+static thread_local RtViolations violations = {0, 0, nullptr};
+
+RtSection::RtSection() { ++rt_depth; }
+
+RtSection::~RtSection() { --rt_depth; }
+
+RtViolations rt_violations() { return violations; }
+
+static inline void flag_alloc(const char *what) {
+  if (rt_depth == 0)
+    return;
+  ++violations.allocations;
+  if (!violations.first)
+    violations.first = what;
+}
+
+static inline void flag_blocking(const char *what) {
+  if (rt_depth == 0)
+    return;
+  ++violations.blocking_calls;
+  if (!violations.first)
+    violations.first = what;
+}
+
+// --- Allocations ---
+
+extern "C" void *malloc(size_t size) {
+  flag_alloc("malloc");
+  return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t n, size_t size) {
+  flag_alloc("calloc");
+  return __libc_calloc(n, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size) {
+  flag_alloc("realloc");
+  return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void *ptr) {
+  if (ptr)
+    flag_alloc("free");
+  __libc_free(ptr);
+}
+
+extern "C" void *aligned_alloc(size_t alignment, size_t size) {
+  flag_alloc("aligned_alloc");
+  return __libc_memalign(alignment, size);
+}
+
+extern "C" void *memalign(size_t alignment, size_t size) {
+  flag_alloc("memalign");
+  return __libc_memalign(alignment, size);
+}
+
+extern "C" int posix_memalign(void **ptr, size_t alignment, size_t size) {
+  flag_alloc("posix_memalign");
+  *ptr = __libc_memalign(alignment, size);
+  return *ptr ? 0 : 12; // ENOMEM
+}
+
+// --- Blocking calls ---
+
+// Resolves the libc implementation on first use. The constructor below
+// touches every wrapper's symbol before main, so no lookup happens inside a
+// section.
+template <typename Fn> static Fn next_symbol(Fn &fn, const char *name) {
+  if (!fn)
+    fn = reinterpret_cast<Fn>(dlsym(RTLD_NEXT, name));
+  return fn;
+}
+
+static ssize_t (*real_read)(int, void *, size_t) = nullptr;
+static ssize_t (*real_write)(int, const void *, size_t) = nullptr;
+static int (*real_open)(const char *, int, ...) = nullptr;
+static int (*real_openat)(int, const char *, int, ...) = nullptr;
+static int (*real_close)(int) = nullptr;
+static int (*real_fsync)(int) = nullptr;
+static int (*real_nanosleep)(const timespec *, timespec *) = nullptr;
+static int (*real_clock_nanosleep)(clockid_t, int, const timespec *,
+                                   timespec *) = nullptr;
+static int (*real_usleep)(useconds_t) = nullptr;
+static int (*real_poll)(pollfd *, nfds_t, int) = nullptr;
+static int (*real_select)(int, fd_set *, fd_set *, fd_set *,
+                          timeval *) = nullptr;
+static int (*real_mutex_lock)(pthread_mutex_t *) = nullptr;
+static int (*real_cond_wait)(pthread_cond_t *, pthread_mutex_t *) = nullptr;
+static int (*real_sem_wait)(sem_t *) = nullptr;
+static long (*real_syscall)(long, ...) = nullptr;
+
+__attribute__((constructor)) static void resolve_real_calls() {
+  next_symbol(real_read, "read");
+  next_symbol(real_write, "write");
+  next_symbol(real_open, "open");
+  next_symbol(real_openat, "openat");
+  next_symbol(real_close, "close");
+  next_symbol(real_fsync, "fsync");
+  next_symbol(real_nanosleep, "nanosleep");
+  next_symbol(real_clock_nanosleep, "clock_nanosleep");
+  next_symbol(real_usleep, "usleep");
+  next_symbol(real_poll, "poll");
+  next_symbol(real_select, "select");
+  next_symbol(real_mutex_lock, "pthread_mutex_lock");
+  next_symbol(real_cond_wait, "pthread_cond_wait");
+  next_symbol(real_sem_wait, "sem_wait");
+  next_symbol(real_syscall, "syscall");
+}
+
+extern "C" ssize_t read(int fd, void *buf, size_t count) {
+  flag_blocking("read");
+  return next_symbol(real_read, "read")(fd, buf, count);
+}
+
+extern "C" ssize_t write(int fd, const void *buf, size_t count) {
+  flag_blocking("write");
+  return next_symbol(real_write, "write")(fd, buf, count);
+}
+
+// The mode argument is only passed when the file may be created
+static bool needs_mode(int flags) {
+  return (flags & O_CREAT) || (flags & O_TMPFILE) == O_TMPFILE;
+}
+
+extern "C" int open(const char *path, int flags, ...) {
+  flag_blocking("open");
+  mode_t mode = 0;
+  if (needs_mode(flags)) {
+    va_list ap;
+    va_start(ap, flags);
+    mode = va_arg(ap, mode_t);
+    va_end(ap);
+  }
+  return next_symbol(real_open, "open")(path, flags, mode);
+}
+
+extern "C" int openat(int dirfd, const char *path, int flags, ...) {
+  flag_blocking("openat");
+  mode_t mode = 0;
+  if (needs_mode(flags)) {
+    va_list ap;
+    va_start(ap, flags);
+    mode = va_arg(ap, mode_t);
+    va_end(ap);
+  }
+  return next_symbol(real_openat, "openat")(dirfd, path, flags, mode);
+}
+
+extern "C" int close(int fd) {
+  flag_blocking("close");
+  return next_symbol(real_close, "close")(fd);
+}
+
+extern "C" int fsync(int fd) {
+  flag_blocking("fsync");
+  return next_symbol(real_fsync, "fsync")(fd);
+}
+
+extern "C" int nanosleep(const timespec *req, timespec *rem) {
+  flag_blocking("nanosleep");
+  return next_symbol(real_nanosleep, "nanosleep")(req, rem);
+}
+
+extern "C" int clock_nanosleep(clockid_t clock, int flags, const timespec *req,
+                               timespec *rem) {
+  flag_blocking("clock_nanosleep");
+  return next_symbol(real_clock_nanosleep, "clock_nanosleep")(clock, flags,
+                                                              req, rem);
+}
+
+extern "C" int usleep(useconds_t usec) {
+  flag_blocking("usleep");
+  return next_symbol(real_usleep, "usleep")(usec);
+}
+
+extern "C" int poll(pollfd *fds, nfds_t nfds, int timeout) {
+  flag_blocking("poll");
+  return next_symbol(real_poll, "poll")(fds, nfds, timeout);
+}
+
+extern "C" int select(int nfds, fd_set *readfds, fd_set *writefds,
+                      fd_set *exceptfds, timeval *timeout) {
+  flag_blocking("select");
+  return next_symbol(real_select, "select")(nfds, readfds, writefds,
+                                            exceptfds, timeout);
+}
+
+extern "C" int pthread_mutex_lock(pthread_mutex_t *mutex) {
+  flag_blocking("pthread_mutex_lock");
+  return next_symbol(real_mutex_lock, "pthread_mutex_lock")(mutex);
+}
+
+extern "C" int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex) {
+  flag_blocking("pthread_cond_wait");
+  return next_symbol(real_cond_wait, "pthread_cond_wait")(cond, mutex);
+}
+
+extern "C" int sem_wait(sem_t *sem) {
+  flag_blocking("sem_wait");
+  return next_symbol(real_sem_wait, "sem_wait")(sem);
+}
+
+// libstdc++ waits on std::atomic / std::binary_semaphore through raw futex
+// syscalls. A wake is fine from real-time code, a wait is not.
+extern "C" long syscall(long number, ...) {
+  va_list ap;
+  va_start(ap, number);
+  long a[6];
+  for (long &arg : a)
+    arg = va_arg(ap, long);
+  va_end(ap);
+
+  if (number == SYS_futex) {
+    int op = a[1] & FUTEX_CMD_MASK;
+    if (op != FUTEX_WAKE && op != FUTEX_WAKE_BITSET && op != FUTEX_WAKE_OP)
+      flag_blocking("futex wait");
+  } else {
+    flag_blocking("syscall");
+  }
+
+  return next_symbol(real_syscall, "syscall")(number, a[0], a[1], a[2], a[3],
+                                              a[4], a[5]);
+}
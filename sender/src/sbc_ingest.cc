@@ -0,0 +1,151 @@
+#include "sbc_ingest.h"
+#include "metrics.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+// RTP header without CSRCs or extension
+#define RTP_HEADER_SIZE 12
+// A2DP SBC payload header: fragmented, start, last, RFA, 4 bit frame count
+#define SBC_PAYLOAD_FRAGMENTED 0x80
+
+static uint32_t sbc_rate(uint8_t frequency) {
+  switch (frequency) {
+  case SBC_FREQ_16000:
+    return 16000;
+  case SBC_FREQ_32000:
+    return 32000;
+  case SBC_FREQ_44100:
+    return 44100;
+  default:
+    return 48000;
+  }
+}
+
+SbcIngest::SbcIngest(PcmFramer *framer) : framer(framer) {
+  if (sbc_init(&this->sbc, 0) < 0)
+    throw std::runtime_error("Failed to initialize the SBC decoder");
+}
+
+SbcIngest::~SbcIngest() { sbc_finish(&this->sbc); }
+
+size_t SbcIngest::decode(const uint8_t *data, size_t n) {
+  int16_t pcm[SBC_INGEST_SAMPLES_MAX];
+  int16_t mono[SBC_INGEST_SAMPLES_MAX];
+  int16_t out[SBC_INGEST_SAMPLES_MAX];
+  size_t used = 0;
+
+  while (used < n) {
+    uint64_t start = metrics_now_ns();
+
+    size_t written = 0;
+    ssize_t len = sbc_decode(&this->sbc, data + used, n - used, pcm,
+                             sizeof(pcm), &written);
+    if (len == -1)
+      break; // the rest of the frame has not arrived yet
+    if (len <= 0) {
+      // Corrupt, look for the next syncword from the following byte
+      ++this->errors;
+      ++used;
+      continue;
+    }
+    used += len;
+    ++this->frames;
+
+    uint32_t channels = this->sbc.mode == SBC_MODE_MONO ? 1 : 2;
+    size_t n_frames = written / sizeof(int16_t) / channels;
+    for (size_t i = 0; i < n_frames; ++i)
+      mono[i] = channels == 1
+                    ? pcm[i]
+                    : static_cast<int16_t>((pcm[2 * i] + pcm[2 * i + 1]) / 2);
+
+    uint64_t decoded = metrics_now_ns();
+    this->decode_ns += decoded - start;
+
+    uint32_t rate = sbc_rate(this->sbc.frequency);
+    if (!this->resampler || this->resampler->in_rate() != rate)
+      this->resampler = std::make_unique<Resampler>(rate, 8000);
+
+    size_t n_out = this->resampler->process(mono, n_frames, out,
+                                            SBC_INGEST_SAMPLES_MAX);
+    this->resample_ns += metrics_now_ns() - decoded;
+
+    if (n_out != 0) {
+      this->framer->process(out, n_out);
+      this->samples_out_ += n_out;
+    }
+  }
+
+  return used;
+}
+
+void SbcIngest::feed_frames(const uint8_t *data, size_t n) {
+  while (n != 0) {
+    size_t copy = std::min(n, sizeof(this->carry) - this->carry_n);
+    memcpy(this->carry + this->carry_n, data, copy);
+    this->carry_n += copy;
+    data += copy;
+    n -= copy;
+
+    size_t used = this->decode(this->carry, this->carry_n);
+
+    // A full buffer without a whole frame in it cannot be SBC
+    if (used == 0 && this->carry_n == sizeof(this->carry)) {
+      ++this->errors;
+      used = 1;
+    }
+
+    memmove(this->carry, this->carry + used, this->carry_n - used);
+    this->carry_n -= used;
+  }
+}
+
+bool SbcIngest::feed_rtp(const uint8_t *packet, size_t n) {
+  if (n < RTP_HEADER_SIZE + 1 || (packet[0] >> 6) != 2) {
+    ++this->packets_dropped;
+    return false;
+  }
+
+  // Padding: its length is the last byte and counts itself
+  if (packet[0] & 0x20) {
+    size_t padding = packet[n - 1];
+    if (padding == 0 || padding > n - RTP_HEADER_SIZE) {
+      ++this->packets_dropped;
+      return false;
+    }
+    n -= padding;
+  }
+
+  size_t offset = RTP_HEADER_SIZE + 4 * (packet[0] & 0x0f);
+  if (packet[0] & 0x10) {
+    if (offset + 4 > n) {
+      ++this->packets_dropped;
+      return false;
+    }
+    offset += 4 + 4 * ((packet[offset + 2] << 8) | packet[offset + 3]);
+  }
+
+  // Fragmented frames only happen with an MTU below one frame, which no
+  // source we capture from uses
+  if (offset + 1 > n || (packet[offset] & SBC_PAYLOAD_FRAGMENTED)) {
+    ++this->packets_dropped;
+    return false;
+  }
+
+  // Packets carry whole frames, nothing is carried to the next one
+  this->decode(packet + offset + 1, n - offset - 1);
+  return true;
+}
+
+void SbcIngest::report() const {
+  std::cout << "sbc-ingest: frames=" << frames << " errors=" << errors
+            << " packets_dropped=" << packets_dropped << " samples_out="
+            << samples_out_ << std::endl;
+  if (frames)
+    std::cout << "sbc-ingest: avg decode " << decode_ns / 1000.0 / frames
+              << " us, resample " << resample_ns / 1000.0 / frames
+              << " us per frame, filter delay " << delay_ms() << " ms"
+              << std::endl;
+}
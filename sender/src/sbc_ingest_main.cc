@@ -0,0 +1,161 @@
+// Feeds SBC audio straight into one device pipeline, skipping PipeWire.
+// The source is either a BlueZ A2DP media transport fd, acquired over
+// D-Bus by the caller and inherited, or a .sbc file for testing.
+//
+// usage: sbc-ingest (--fd N | --file PATH [--fast]) [--config PATH]
+
+#include "codec2_build.h"
+#include "config.h"
+#include "pipeline.h"
+#include "sbc_ingest.h"
+#include "thread_profile.h"
+
+#include <poll.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+
+// Largest media packet read from a transport, above any A2DP MTU
+#define SBC_INGEST_PACKET_MAX 4096
+#define SBC_INGEST_POLL_MS 100
+
+static std::atomic<bool> quit = false;
+
+static void quit_handler(int) { quit = true; }
+
+static void usage() {
+  std::cerr << "usage: sbc-ingest (--fd N | --file PATH [--fast]) "
+               "[--config PATH]"
+            << std::endl;
+}
+
+// Transport packets as they arrive, until the source closes it
+static void ingest_transport(int fd, SbcIngest &ingest) {
+  uint8_t packet[SBC_INGEST_PACKET_MAX];
+  pollfd pfd = {fd, POLLIN, 0};
+
+  while (!quit) {
+    int ready = poll(&pfd, 1, SBC_INGEST_POLL_MS);
+    if (ready == 0 || (ready < 0 && errno == EINTR))
+      continue;
+
+    ssize_t n = ready > 0 ? read(fd, packet, sizeof(packet)) : -1;
+    if (n < 0 && (errno == EAGAIN || errno == EINTR))
+      continue;
+    if (n <= 0) {
+      std::cout << "sbc-ingest: transport closed" << std::endl;
+      break;
+    }
+
+    ingest.feed_rtp(packet, n);
+  }
+}
+
+// The file's frames at the rate they play, or as fast as the encoder keeps
+// up
+static void ingest_file(std::ifstream &file, SbcIngest &ingest,
+                        DevicePipeline &pipeline, bool fast) {
+  uint8_t chunk[SBC_INGEST_FRAME_MAX];
+  auto start = std::chrono::steady_clock::now();
+
+  while (!quit && file) {
+    file.read(reinterpret_cast<char *>(chunk), sizeof(chunk));
+    ingest.feed_frames(chunk, file.gcount());
+
+    if (fast) {
+      while (pipeline.backlogged())
+        std::this_thread::yield();
+    } else {
+      std::this_thread::sleep_until(
+          start + std::chrono::microseconds(ingest.samples_out() * 1000000 /
+                                            8000));
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  int fd = -1;
+  std::string path;
+  std::string config_path = CONFIG_PATH;
+  bool fast = false;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--fast") {
+      fast = true;
+      continue;
+    }
+    if (i + 1 == argc) {
+      usage();
+      return EXIT_FAILURE;
+    }
+
+    const char *value = argv[++i];
+    if (arg == "--fd") {
+      fd = atoi(value);
+    } else if (arg == "--file") {
+      path = value;
+    } else if (arg == "--config") {
+      config_path = value;
+    } else {
+      usage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  if ((fd < 0) == path.empty() || (fast && fd >= 0)) {
+    usage();
+    return EXIT_FAILURE;
+  }
+
+  struct sigaction sa{};
+  sa.sa_handler = quit_handler;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, nullptr);
+  sigaction(SIGTERM, &sa, nullptr);
+
+  try {
+    codec2_build_check();
+    config_init(config_path);
+    thread_profile_lock_memory();
+
+    std::ifstream file;
+    if (!path.empty()) {
+      file.open(path, std::ios::binary);
+      if (!file)
+        throw std::runtime_error("Cannot open " + path);
+    }
+
+    DevicePipeline pipeline(0, path.empty() ? "sbc:fd" + std::to_string(fd)
+                                            : "sbc:" + path);
+    SbcIngest ingest(pipeline.framer());
+
+    // This thread does the capture callback's job now
+    thread_profile_apply(ThreadStage::Capture);
+
+    if (fd >= 0)
+      ingest_transport(fd, ingest);
+    else
+      ingest_file(file, ingest, pipeline, fast);
+
+    pipeline.close();
+    ingest.report();
+  } catch (const std::exception &ex) {
+    std::cerr << "Error: " << ex.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (fd >= 0)
+    close(fd);
+
+  return EXIT_SUCCESS;
+}
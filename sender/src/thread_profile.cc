@@ -0,0 +1,113 @@
+#include "thread_profile.h"
+#include "config.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+struct ThreadPlacement {
+  const char *name;
+  int Config::*priority;
+  int Config::*cpu;
+};
+
+static const ThreadPlacement placements[] = {
+    {"capture", &Config::thread_capture_priority, &Config::thread_capture_cpu},
+    {"encoder", &Config::thread_encoder_priority, &Config::thread_encoder_cpu},
+    {"decoder", &Config::thread_decoder_priority, &Config::thread_decoder_cpu},
+    {"pool", &Config::thread_pool_priority, &Config::thread_pool_cpu},
+};
+static_assert(std::size(placements) ==
+              static_cast<size_t>(ThreadStage::Count));
+
+// Every device starts the same threads, warn once per stage
+static std::atomic<bool> warned[static_cast<size_t>(ThreadStage::Count)];
+
+static void warn(ThreadStage stage, const std::string &what) {
+  if (warned[static_cast<size_t>(stage)].exchange(true))
+    return;
+
+  std::cerr << "thread profile: " << placements[static_cast<size_t>(stage)].name
+            << ": " << what << ", continuing without it" << std::endl;
+}
+
+void thread_profile_apply(ThreadStage stage) {
+  const ThreadPlacement &placement = placements[static_cast<size_t>(stage)];
+  const Config *config = config_current();
+  int cpu = config->*placement.cpu;
+  int priority = config->*placement.priority;
+
+  if (cpu >= 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    int err = cpu < cpus
+                  ? pthread_setaffinity_np(pthread_self(), sizeof(set), &set)
+                  : EINVAL;
+    if (err)
+      warn(stage, "cannot pin to CPU " + std::to_string(cpu) + ": " +
+                      strerror(err));
+  }
+
+  if (priority > 0) {
+    sched_param param{};
+    param.sched_priority = priority;
+
+    // Needs CAP_SYS_NICE or an RLIMIT_RTPRIO of at least the priority
+    int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (err)
+      warn(stage, "cannot use SCHED_FIFO priority " +
+                      std::to_string(priority) + ": " + strerror(err));
+  }
+}
+
+void thread_profile_lock_memory() {
+  if (!config_current()->thread_mlockall)
+    return;
+
+  int flags = MCL_CURRENT | MCL_FUTURE;
+#ifdef MCL_ONFAULT
+  // Thread stacks would otherwise be locked in full as soon as mapped
+  flags |= MCL_ONFAULT;
+#endif
+
+  if (mlockall(flags) < 0)
+    std::cerr << "thread profile: cannot lock memory: " << strerror(errno)
+              << ", continuing without it" << std::endl;
+}
+
+void JitterMeter::wake(uint64_t media_ns, bool restart) {
+  uint64_t now_ns = metrics_now_ns();
+
+  // An earlier wakeup than the reference becomes the new reference
+  if (restart || !started || now_ns < anchor_ns + media_ns) {
+    started = true;
+    anchor_ns = now_ns - media_ns;
+  }
+
+  uint64_t late_ns = now_ns - anchor_ns - media_ns;
+  metrics->observe(Histogram::WakeupJitter, late_ns);
+
+  ++wakeups;
+  sum_ns += late_ns;
+  if (late_ns > max_ns)
+    max_ns = late_ns;
+}
+
+void JitterMeter::report(const char *stage) const {
+  if (wakeups == 0)
+    return;
+
+  std::cout << "jitter: " << stage << " wakeups=" << wakeups
+            << " mean=" << sum_ns / wakeups / 1000.0
+            << "us max=" << max_ns / 1000.0 << "us" << std::endl;
+}
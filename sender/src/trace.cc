@@ -0,0 +1,180 @@
+#include "trace.h"
+
+#ifdef PIPELINE_TRACE
+
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+// Relaxed atomics, the dumper reads slots the writer may be overwriting
+struct TraceEvent {
+  std::atomic<const char *> name;
+  std::atomic<uint64_t> ts_ns;
+  std::atomic<char> phase;
+};
+
+// Single writer ring, the dumper reads it concurrently and drops whatever
+// the writer lapped while it was copying. A ring outlives its thread until
+// another thread claims it, events from before start are the old thread's.
+struct TraceRing {
+  std::atomic<uint64_t> head = 0;
+  std::atomic<uint64_t> start = 0;
+  std::atomic<pid_t> tid = 0;
+  std::atomic<bool> in_use = false;
+  TraceEvent events[TRACE_EVENTS_PER_THREAD];
+};
+
+// Preallocated so the first event of a real-time thread does not allocate
+static TraceRing rings[TRACE_THREADS_MAX];
+static std::atomic<uint32_t> rings_n = 0;
+// Threads that found every ring taken, they are not traced
+static std::atomic<uint32_t> threads_untraced = 0;
+
+static thread_local TraceRing *thread_ring = nullptr;
+
+// Hands the ring back when its thread exits. A pthread key rather than a
+// thread_local destructor, whose registration allocates on first use.
+static void release_ring(void *ring) {
+  static_cast<TraceRing *>(ring)->in_use.store(false,
+                                               std::memory_order_release);
+}
+
+static pthread_key_t make_ring_key() {
+  pthread_key_t key;
+  pthread_key_create(&key, &release_ring);
+  return key;
+}
+
+static pthread_key_t ring_key = make_ring_key();
+
+// A never used ring, else one whose thread has exited
+static TraceRing *claim_ring() {
+  uint32_t idx = rings_n.load(std::memory_order_relaxed);
+  while (idx < TRACE_THREADS_MAX) {
+    if (rings_n.compare_exchange_weak(idx, idx + 1,
+                                      std::memory_order_relaxed)) {
+      rings[idx].in_use.store(true, std::memory_order_relaxed);
+      return &rings[idx];
+    }
+  }
+
+  for (TraceRing &ring : rings) {
+    bool free = false;
+    if (ring.in_use.compare_exchange_strong(free, true,
+                                            std::memory_order_acquire))
+      return &ring;
+  }
+
+  return nullptr;
+}
+
+static uint64_t trace_now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void trace_event(const char *name, char phase) {
+  TraceRing *ring = thread_ring;
+
+  if (!ring) {
+    // Once per thread, so an untraced thread is only counted once too
+    static thread_local bool untraced = false;
+    if (untraced)
+      return;
+
+    ring = claim_ring();
+    if (!ring) {
+      untraced = true;
+      threads_untraced.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    ring->tid.store(syscall(SYS_gettid), std::memory_order_relaxed);
+    ring->start.store(ring->head.load(std::memory_order_relaxed),
+                      std::memory_order_release);
+    pthread_setspecific(ring_key, ring);
+    thread_ring = ring;
+  }
+
+  uint64_t head = ring->head.load(std::memory_order_relaxed);
+  TraceEvent &ev = ring->events[head % TRACE_EVENTS_PER_THREAD];
+
+  // Pairs with the dumper's acquire fence: once it sees any of these
+  // stores it also sees the head published before them
+  std::atomic_thread_fence(std::memory_order_release);
+  ev.name.store(name, std::memory_order_relaxed);
+  ev.ts_ns.store(trace_now_ns(), std::memory_order_relaxed);
+  ev.phase.store(phase, std::memory_order_relaxed);
+  ring->head.store(head + 1, std::memory_order_release);
+}
+
+void trace_dump(const std::string &path) {
+  std::ofstream out(path);
+  if (!out) {
+    std::cerr << "trace: cannot write " << path << std::endl;
+    return;
+  }
+
+  uint32_t n = std::min<uint32_t>(rings_n.load(std::memory_order_acquire),
+                                  TRACE_THREADS_MAX);
+  bool first = true;
+  size_t written = 0;
+
+  // Steady clock microseconds are around 1e10, the default precision would
+  // round them to the same few values
+  out << std::fixed << std::setprecision(3);
+  out << "{\"traceEvents\":[\n";
+
+  for (uint32_t r = 0; r < n; ++r) {
+    TraceRing &ring = rings[r];
+    uint64_t start = ring.start.load(std::memory_order_acquire);
+    pid_t tid = ring.tid.load(std::memory_order_relaxed);
+    uint64_t head = ring.head.load(std::memory_order_acquire);
+    uint64_t begin =
+        head > TRACE_EVENTS_PER_THREAD ? head - TRACE_EVENTS_PER_THREAD : 0;
+    begin = std::max(begin, start);
+
+    for (uint64_t i = begin; i < head; ++i) {
+      const TraceEvent &slot = ring.events[i % TRACE_EVENTS_PER_THREAD];
+      const char *name = slot.name.load(std::memory_order_relaxed);
+      uint64_t ts_ns = slot.ts_ns.load(std::memory_order_relaxed);
+      char phase = slot.phase.load(std::memory_order_relaxed);
+
+      // Keeps the loads above from moving past the head check below
+      std::atomic_thread_fence(std::memory_order_acquire);
+
+      // Slot was reused by the writer after we read head
+      uint64_t now_head = ring.head.load(std::memory_order_relaxed);
+      if (now_head >= i + TRACE_EVENTS_PER_THREAD)
+        continue;
+
+      out << (first ? "" : ",\n") << "{\"name\":\"" << name
+          << "\",\"ph\":\"" << phase << "\",\"ts\":" << ts_ns / 1000.0
+          << ",\"pid\":" << getpid() << ",\"tid\":" << tid << "}";
+      first = false;
+      ++written;
+    }
+  }
+
+  out << "\n]}\n";
+
+  std::cout << "trace: wrote " << written << " events from " << n
+            << " threads to " << path << std::endl;
+
+  uint32_t untraced = threads_untraced.load(std::memory_order_relaxed);
+  if (untraced)
+    std::cerr << "trace: warning: " << untraced
+              << " threads found no free ring and are missing, raise "
+                 "TRACE_THREADS_MAX"
+              << std::endl;
+}
+
+#endif
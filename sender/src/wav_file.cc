@@ -1,20 +1,8 @@
 #include "wav_file.h"
+#include "trace.h"
 
-struct WavHeader {
-  char riff[4] = {'R', 'I', 'F', 'F'};
-  uint32_t chunk_size = 0; // placeholder
-  char wave[4] = {'W', 'A', 'V', 'E'};
-  char fmt[4] = {'f', 'm', 't', ' '};
-  uint32_t subchunk1_size = 16;
-  uint16_t audio_format = 1; // PCM
-  uint16_t num_channels = 1;
-  uint32_t sample_rate = 8000;
-  uint32_t byte_rate = 0;   // placeholder
-  uint16_t block_align = 0; // placeholder
-  uint16_t bits_per_sample = 16;
-  char data[4] = {'d', 'a', 't', 'a'};
-  uint32_t subchunk2_size = 0; // placeholder
-};
+#include <cstring>
+#include <stdexcept>
 
 static WavHeader standard_header() {
   WavHeader header;
@@ -26,28 +14,76 @@ static WavHeader standard_header() {
 }
 
 WavFile::WavFile(std::string filename)
-    : fs(filename, std::ios::binary), header(new WavHeader()), n_samples(0) {
-  *header = standard_header();
-  fs.write(reinterpret_cast<const char *>(header), sizeof(WavHeader));
+    : fs(filename, std::ios::binary), header(standard_header()),
+      n_samples(0) {
+  fs.write(reinterpret_cast<const char *>(&header), sizeof(WavHeader));
 }
 
 WavFile::~WavFile() {
   uint32_t data_size = sizeof(int16_t) * n_samples;
-  header->subchunk2_size = data_size;
-  header->chunk_size = 36 + data_size;
+  header.subchunk2_size = data_size;
+  header.chunk_size = 36 + data_size;
 
   std::cout << "Wav File destructor is called, updating the headers: samples = "
             << n_samples << std::endl;
 
   fs.seekp(0, std::ios::beg);
-  fs.write(reinterpret_cast<const char *>(header), sizeof(WavHeader));
+  fs.write(reinterpret_cast<const char *>(&header), sizeof(WavHeader));
   fs.close();
 }
 
 void WavFile::write_pcm(const PcmData &pcm_data) {
+  TRACE_SCOPE("WavFile::write_pcm");
+
   n_samples += PCM_SAMPLE_MAX;
 
   fs.write(reinterpret_cast<const char *>(pcm_data.samples),
            sizeof(pcm_data.samples));
   // fs.flush();
+}
+
+std::vector<int16_t> read_wav(const std::string &filename) {
+  std::ifstream in(filename, std::ios::binary);
+  if (!in)
+    throw std::runtime_error("Failed to open " + filename);
+
+  char riff[12];
+  if (!in.read(riff, sizeof(riff)) || memcmp(riff, "RIFF", 4) != 0 ||
+      memcmp(riff + 8, "WAVE", 4) != 0)
+    throw std::runtime_error(filename + " is not a WAV file");
+
+  const WavHeader expected = standard_header();
+  bool have_format = false;
+
+  // Walk the chunks, other tools add LIST and similar ones
+  char id[4];
+  uint32_t size;
+  while (in.read(id, sizeof(id)) &&
+         in.read(reinterpret_cast<char *>(&size), sizeof(size))) {
+    if (memcmp(id, "fmt ", 4) == 0) {
+      WavHeader format;
+      if (size < 16 ||
+          !in.read(reinterpret_cast<char *>(&format.audio_format), 16))
+        break;
+      if (format.audio_format != expected.audio_format ||
+          format.num_channels != expected.num_channels ||
+          format.sample_rate != expected.sample_rate ||
+          format.bits_per_sample != expected.bits_per_sample)
+        throw std::runtime_error(filename + " is not 8 kHz mono S16");
+      in.seekg(size - 16 + (size & 1), std::ios::cur);
+      have_format = true;
+    } else if (memcmp(id, "data", 4) == 0) {
+      if (!have_format)
+        break;
+      std::vector<int16_t> samples(size / sizeof(int16_t));
+      in.read(reinterpret_cast<char *>(samples.data()),
+              samples.size() * sizeof(int16_t));
+      samples.resize(in.gcount() / sizeof(int16_t));
+      return samples;
+    } else {
+      in.seekg(size + (size & 1), std::ios::cur);
+    }
+  }
+
+  throw std::runtime_error(filename + " has no audio data");
 }
\ No newline at end of file
@@ -0,0 +1,220 @@
+// Compares two ways of running many I/O-bound consumers: one thread per
+// consumer blocked in MsgQueue::recv(), and coroutines awaiting
+// MsgQueue::async_recv() on a small Executor. A producer thread sends one
+// frame to every consumer each period, like the encoders of that many
+// streams. Each consumer writes its frame to /dev/null.
+//
+// usage: async-bench [--streams N] [--workers N] [--seconds N]
+//                    [--period-ms N]
+
+#include "MsgQueue.h"
+#include "bitrate.h"
+#include "data.h"
+#include "executor.h"
+#include "packet.h"
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define ASYNC_BENCH_STREAMS 256
+#define ASYNC_BENCH_SECONDS 5
+#define ASYNC_BENCH_QUEUE_SIZE 16
+
+struct BenchConfig {
+  uint32_t streams = ASYNC_BENCH_STREAMS;
+  uint32_t workers = EXECUTOR_THREADS;
+  uint32_t seconds = ASYNC_BENCH_SECONDS;
+  uint32_t period_ms = FRAME_PERIOD_NS / 1000000;
+};
+
+struct Message {
+  uint64_t sent_ns;
+  Codec2Data data;
+};
+
+struct Consumer {
+  MsgQueue<Message> queue{ASYNC_BENCH_QUEUE_SIZE};
+  int fd = -1;
+  std::vector<uint32_t> latency_us;
+
+  void handle(const Message &message) {
+    latency_us.push_back((packet_now_ns() - message.sent_ns) / 1000);
+    if (write(fd, message.data.bytes, message.data.n_bytes) < 0)
+      std::cerr << "async-bench: write failed" << std::endl;
+  }
+};
+
+struct Usage {
+  uint64_t switches;
+  uint64_t cpu_us;
+};
+
+static Usage usage() {
+  rusage ru{};
+  getrusage(RUSAGE_SELF, &ru);
+  auto us = [](const timeval &tv) {
+    return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+  };
+  return {static_cast<uint64_t>(ru.ru_nvcsw + ru.ru_nivcsw),
+          us(ru.ru_utime) + us(ru.ru_stime)};
+}
+
+static uint32_t thread_count() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line))
+    if (line.rfind("Threads:", 0) == 0)
+      return std::stoul(line.substr(8));
+  return 0;
+}
+
+static Task consume(Consumer &consumer) {
+  while (auto message = co_await consumer.queue.async_recv())
+    consumer.handle(*message);
+}
+
+// Sends a frame to every consumer each period, then closes the queues
+static uint64_t produce(const BenchConfig &config,
+                        std::vector<std::unique_ptr<Consumer>> &consumers) {
+  uint64_t dropped = 0;
+  uint64_t periods = config.seconds * 1000ull / config.period_ms;
+  auto start = std::chrono::steady_clock::now();
+
+  for (uint64_t period = 0; period < periods; ++period) {
+    for (uint32_t i = 0; i < consumers.size(); ++i) {
+      Message message{};
+      message.data.stream_id = i;
+      message.data.piece_id = period;
+      message.data.n_bytes = 4;
+      message.sent_ns = packet_now_ns();
+      if (!consumers[i]->queue.send(message))
+        ++dropped;
+    }
+
+    std::this_thread::sleep_until(
+        start + std::chrono::milliseconds((period + 1) * config.period_ms));
+  }
+
+  for (auto &consumer : consumers)
+    consumer->queue.close();
+
+  return dropped;
+}
+
+static void run(const char *model, const BenchConfig &config, int null_fd) {
+  std::vector<std::unique_ptr<Consumer>> consumers;
+  for (uint32_t i = 0; i < config.streams; ++i) {
+    consumers.push_back(std::make_unique<Consumer>());
+    consumers.back()->fd = null_fd;
+    consumers.back()->latency_us.reserve(config.seconds * 1000ull /
+                                         config.period_ms);
+  }
+
+  Usage before = usage();
+  uint32_t threads = 0;
+  uint64_t dropped = 0;
+
+  if (strcmp(model, "threads") == 0) {
+    std::vector<std::thread> workers;
+    for (auto &consumer : consumers)
+      workers.emplace_back([&consumer] {
+        while (auto message = consumer->queue.recv())
+          consumer->handle(*message);
+      });
+
+    threads = thread_count();
+    dropped = produce(config, consumers);
+
+    for (auto &worker : workers)
+      worker.join();
+  } else {
+    Executor executor(config.workers, ThreadStage::Decoder);
+    for (auto &consumer : consumers)
+      executor.spawn(consume(*consumer));
+
+    threads = thread_count();
+    dropped = produce(config, consumers);
+  }
+
+  Usage after = usage();
+
+  std::vector<uint32_t> latency_us;
+  for (auto &consumer : consumers)
+    latency_us.insert(latency_us.end(), consumer->latency_us.begin(),
+                      consumer->latency_us.end());
+  std::sort(latency_us.begin(), latency_us.end());
+  auto pct = [&](double p) -> uint32_t {
+    if (latency_us.empty())
+      return 0;
+    return latency_us[std::min(latency_us.size() - 1,
+                               static_cast<size_t>(p * latency_us.size()))];
+  };
+
+  uint64_t switches = after.switches - before.switches;
+  std::cout << "async-bench: " << model << ": " << config.streams
+            << " consumers on " << threads << " threads, "
+            << latency_us.size() << " frames (" << dropped << " dropped), "
+            << switches << " context switches ("
+            << switches / config.seconds << "/s), cpu "
+            << (after.cpu_us - before.cpu_us) / 1000 << " ms" << std::endl;
+  std::cout << "async-bench: " << model << ": latency p50=" << pct(0.5)
+            << "us p99=" << pct(0.99) << "us max=" << pct(1.0) << "us"
+            << std::endl;
+}
+
+static bool parse_args(int argc, char **argv, BenchConfig &config) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (i + 1 == argc)
+      return false;
+
+    uint32_t value = atoi(argv[++i]);
+    if (arg == "--streams")
+      config.streams = value;
+    else if (arg == "--workers")
+      config.workers = value;
+    else if (arg == "--seconds")
+      config.seconds = value;
+    else if (arg == "--period-ms")
+      config.period_ms = value;
+    else
+      return false;
+  }
+
+  return config.streams > 0 && config.workers > 0 && config.seconds > 0 &&
+         config.period_ms > 0;
+}
+
+int main(int argc, char **argv) {
+  BenchConfig config;
+  if (!parse_args(argc, argv, config)) {
+    std::cerr << "usage: async-bench [--streams N] [--workers N] "
+                 "[--seconds N] [--period-ms N]"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+  if (null_fd < 0) {
+    std::cerr << "Error: cannot open /dev/null" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  run("threads", config, null_fd);
+  run("executor", config, null_fd);
+
+  close(null_fd);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,172 @@
+// Producer/consumer throughput of SPSCByteRing against fixed size slots of
+// rigtorp::SPSCQueue, for the record size mixes the pipeline carries:
+// encoded frames of every mode plus SID markers, and relay packets. Both
+// queues get the same number of bytes. Waiting sides yield so the numbers
+// stay meaningful when both threads share a CPU.
+//
+// usage: byte-ring-bench [records]
+
+#include "SPSCByteRing.h"
+#include "SPSCQueue.h"
+#include "data.h"
+#include "packet.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define BYTE_RING_BENCH_RECORDS 20000000ull
+#define BYTE_RING_BENCH_BYTES (64 * 1024)
+
+// stream, session, piece, type, mode, n_bytes: what a compact frame
+// record carries ahead of its payload
+#define FRAME_IDS_SIZE 15
+
+struct Mix {
+  const char *name;
+  std::vector<uint32_t> sizes; // payload sizes, cycled
+};
+
+// Payload sizes of 40 ms of each mode (3200, 2400, 1300, 700C) and a SID,
+// weighted towards the low modes a loaded link settles on
+static Mix frame_mix() {
+  Mix mix{"frames", {}};
+  const uint32_t payload[] = {16, 12, 7, 4, 4, 4, 7, 1};
+  for (uint32_t p : payload)
+    mix.sizes.push_back(FRAME_IDS_SIZE + p);
+  return mix;
+}
+
+static Mix packet_mix() {
+  Mix mix{"packets", {}};
+  const uint32_t payload[] = {16, 12, 7, 4, 4, 4, 7, 1};
+  for (uint32_t p : payload)
+    mix.sizes.push_back(PACKET_HEADER_SIZE + p);
+  return mix;
+}
+
+struct Result {
+  double seconds;
+  uint64_t checksum;
+  size_t slots; // records the queue holds when full of the average record
+};
+
+static void report(const char *queue, const Mix &mix, uint64_t records,
+                   uint64_t payload_bytes, const Result &r) {
+  std::cout << "byte-ring-bench: " << mix.name << " " << queue << " "
+            << records / r.seconds / 1e6 << " Mrecords/s "
+            << payload_bytes / r.seconds / 1e6 << " MB/s, holds ~"
+            << r.slots << " records (checksum " << r.checksum << ")"
+            << std::endl;
+}
+
+static Result run_ring(const Mix &mix, uint64_t records) {
+  SPSCByteRing<> ring(BYTE_RING_BENCH_BYTES);
+  uint64_t checksum = 0;
+
+  auto start = std::chrono::steady_clock::now();
+
+  std::thread consumer([&] {
+    for (uint64_t i = 0; i < records;) {
+      auto record = ring.front();
+      if (!record) {
+        std::this_thread::yield();
+        continue;
+      }
+      checksum += record->payload.size() + record->payload[0];
+      ring.pop();
+      ++i;
+    }
+  });
+
+  for (uint64_t i = 0; i < records; ++i) {
+    uint32_t size = mix.sizes[i % mix.sizes.size()];
+    uint8_t *dst;
+    while (!(dst = ring.reserve(size)))
+      std::this_thread::yield();
+    memset(dst, static_cast<uint8_t>(i), size);
+    ring.commit(size, 0);
+  }
+
+  consumer.join();
+
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+  uint64_t avg = 0;
+  for (uint32_t size : mix.sizes)
+    avg += (8 + size + 7) & ~7u;
+  avg /= mix.sizes.size();
+
+  return {seconds, checksum, BYTE_RING_BENCH_BYTES / avg};
+}
+
+template <size_t SlotSize>
+static Result run_slots(const Mix &mix, uint64_t records) {
+  struct Slot {
+    uint32_t size;
+    uint8_t bytes[SlotSize];
+  };
+
+  rigtorp::SPSCQueue<Slot> queue(BYTE_RING_BENCH_BYTES / sizeof(Slot));
+  uint64_t checksum = 0;
+
+  auto start = std::chrono::steady_clock::now();
+
+  std::thread consumer([&] {
+    for (uint64_t i = 0; i < records;) {
+      Slot *slot = queue.front();
+      if (!slot) {
+        std::this_thread::yield();
+        continue;
+      }
+      checksum += slot->size + slot->bytes[0];
+      queue.pop();
+      ++i;
+    }
+  });
+
+  for (uint64_t i = 0; i < records; ++i) {
+    uint32_t size = mix.sizes[i % mix.sizes.size()];
+    Slot slot;
+    slot.size = size;
+    memset(slot.bytes, static_cast<uint8_t>(i), size);
+    while (!queue.try_push(slot))
+      std::this_thread::yield();
+  }
+
+  consumer.join();
+
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+  return {seconds, checksum, queue.capacity()};
+}
+
+int main(int argc, char **argv) {
+  uint64_t records =
+      argc > 1 ? std::stoull(argv[1]) : BYTE_RING_BENCH_RECORDS;
+
+  for (const Mix &mix : {frame_mix(), packet_mix()}) {
+    uint64_t payload_bytes = 0;
+    for (uint64_t i = 0; i < mix.sizes.size(); ++i)
+      payload_bytes += mix.sizes[i];
+    payload_bytes = payload_bytes * records / mix.sizes.size();
+
+    report("byte-ring", mix, records, payload_bytes, run_ring(mix, records));
+    if (mix.name == std::string("frames"))
+      report("fixed-slots", mix, records, payload_bytes,
+             run_slots<FRAME_IDS_SIZE + CODEC2_FRAME_MAX>(mix, records));
+    else
+      report("fixed-slots", mix, records, payload_bytes,
+             run_slots<PACKET_SIZE_MAX>(mix, records));
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,120 @@
+// Feeds a capture trace recorded with SENDER_CAPTURE_RECORD through the
+// same framing, session and encoder code as the sender, either with the
+// recorded callback timing or as fast as the encoders keep up, and reports
+// how long the capture path and the whole pipeline took.
+
+#include "capture_trace.h"
+#include "metrics.h"
+#include "pipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+static void usage() {
+  std::cerr << "usage: capture-replay <trace> [--fast]" << std::endl;
+}
+
+static void print_latency(const char *what, std::vector<uint64_t> &ns) {
+  if (ns.empty())
+    return;
+
+  std::sort(ns.begin(), ns.end());
+  uint64_t sum = 0;
+  for (uint64_t v : ns)
+    sum += v;
+
+  std::cout << "capture-replay: " << what << " n=" << ns.size()
+            << " mean=" << sum / ns.size() / 1000.0
+            << "us p50=" << ns[ns.size() / 2] / 1000.0
+            << "us p99=" << ns[ns.size() * 99 / 100] / 1000.0
+            << "us max=" << ns.back() / 1000.0 << "us" << std::endl;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2 || argc > 3) {
+    usage();
+    return EXIT_FAILURE;
+  }
+
+  bool fast = argc == 3 && std::string(argv[2]) == "--fast";
+  if (argc == 3 && !fast) {
+    usage();
+    return EXIT_FAILURE;
+  }
+
+  std::map<uint32_t, std::unique_ptr<DevicePipeline>> pipelines;
+  std::vector<uint64_t> callback_ns;
+  uint64_t samples_n = 0;
+  uint64_t start_ns = metrics_now_ns();
+  uint64_t first_ts = 0;
+
+  try {
+    CaptureReplay replay(argv[1]);
+    CaptureTraceRecord record;
+    std::vector<int16_t> samples;
+
+    while (replay.next(record, samples)) {
+      auto it = pipelines.find(record.stream_id);
+      if (it == pipelines.end())
+        it = pipelines
+                 .emplace(record.stream_id,
+                          std::make_unique<DevicePipeline>(
+                              record.stream_id,
+                              "replay-" + std::to_string(record.stream_id)))
+                 .first;
+      DevicePipeline &pipeline = *it->second;
+
+      if (fast) {
+        // Deterministic: never let a stage drop for lack of queue space
+        while (pipeline.backlogged())
+          std::this_thread::yield();
+      } else {
+        if (!first_ts)
+          first_ts = record.timestamp_ns;
+        std::this_thread::sleep_until(
+            std::chrono::steady_clock::time_point(std::chrono::nanoseconds(
+                start_ns + record.timestamp_ns - first_ts)));
+      }
+
+      uint64_t t0 = metrics_now_ns();
+      pipeline.framer()->process(samples.data(), record.n_samples);
+      callback_ns.push_back(metrics_now_ns() - t0);
+      samples_n += record.n_samples;
+    }
+  } catch (const std::exception &ex) {
+    std::cerr << "Error: " << ex.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  uint64_t fed_ns = metrics_now_ns() - start_ns;
+  // Kept alive until the end, the metrics registry points at their names
+  for (auto &[stream_id, pipeline] : pipelines)
+    pipeline->close();
+  uint64_t total_ns = metrics_now_ns() - start_ns;
+
+  double audio_s = samples_n / 8000.0;
+  std::cout << "capture-replay: " << audio_s << " s of audio, fed in "
+            << fed_ns / 1e9 << " s, pipeline done in " << total_ns / 1e9
+            << " s (" << audio_s / (total_ns / 1e9) << "x real time)"
+            << std::endl;
+  print_latency("capture callback", callback_ns);
+
+  // Frame counters and encode time are enough to compare two runs
+  std::istringstream metrics(MetricsServer::render());
+  for (std::string line; std::getline(metrics, line);) {
+    if (line.rfind("sender_frames_", 0) == 0 ||
+        line.rfind("sender_encode_seconds_sum", 0) == 0 ||
+        line.rfind("sender_encode_seconds_count", 0) == 0)
+      std::cout << line << "\n";
+  }
+
+  return EXIT_SUCCESS;
+}
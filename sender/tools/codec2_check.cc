@@ -0,0 +1,307 @@
+// Compares the linked codec2 with a reference run of another build, usually
+// the stock one, over synthetic speech in every mode the sender uses: the
+// bits it encodes, the audio it decodes from the reference's bits, and how
+// fast it does both. Run the stock build with --save first, then the build
+// under test against that file, which ctest does once SENDER_CODEC2_REFERENCE
+// names it.
+//
+// usage: codec2-check --save FILE
+//        codec2-check FILE
+
+#include "codec2.h"
+#include "codec2_build.h"
+#include "data.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#define CODEC2_CHECK_SECONDS 30
+// Timings are the best of this many runs
+#define CODEC2_CHECK_PASSES 3
+// Share of frames whose bits may differ from the reference. Reassociated
+// sums move the odd pitch or LSP decision across a quantizer step.
+#define CODEC2_CHECK_MAX_FRAMES_DIFF 0.05
+// Audio decoded from the same bits must stay this close to the reference
+#define CODEC2_CHECK_MIN_SNR_DB 30.0
+
+#define CODEC2_CHECK_MAGIC 0x4b433243 // "C2CK"
+
+static const char *mode_names[CODEC2_MODES_N] = {"3200", "2400", "1300",
+                                                 "700C"};
+
+struct ModeRun {
+  int mode;
+  uint32_t bytes_per_frame;
+  uint32_t samples_per_frame;
+  std::vector<uint8_t> bits;
+  // Decoded from the reference bits when there is a reference
+  std::vector<int16_t> pcm;
+  uint64_t encode_ns;
+  uint64_t decode_ns;
+};
+
+struct CheckRun {
+  std::string build;
+  std::vector<ModeRun> modes;
+};
+
+// Voiced bursts on a gliding pitch with unvoiced hiss between them, so
+// both the pitch estimator and the voicing decision get exercised
+static std::vector<int16_t> make_workload() {
+  std::vector<int16_t> samples(CODEC2_CHECK_SECONDS * 8000);
+  uint32_t noise = 1;
+  double phase = 0;
+
+  for (size_t i = 0; i < samples.size(); ++i) {
+    double t = i / 8000.0;
+    double pitch = 120 + 60 * std::sin(2 * M_PI * 0.3 * t);
+    phase += 2 * M_PI * pitch / 8000.0;
+
+    double v = 0;
+    if (std::fmod(t, 0.5) < 0.35) {
+      double env = std::sin(M_PI * std::fmod(t, 0.5) / 0.35);
+      for (int h = 1; h <= 8; ++h)
+        v += env * std::sin(h * phase) / h;
+    } else {
+      noise = noise * 1664525 + 1013904223;
+      v = 0.2 * (static_cast<int32_t>(noise) / 2147483648.0);
+    }
+    samples[i] = static_cast<int16_t>(7000 * v);
+  }
+
+  return samples;
+}
+
+static uint64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static ModeRun run_mode(int idx, const std::vector<int16_t> &workload,
+                        const ModeRun *reference) {
+  ModeRun run = {};
+  run.mode = CODEC2_MODES[idx];
+  run.encode_ns = std::numeric_limits<uint64_t>::max();
+  run.decode_ns = std::numeric_limits<uint64_t>::max();
+
+  for (int pass = 0; pass < CODEC2_CHECK_PASSES; ++pass) {
+    CODEC2 *codec2 = codec2_create(run.mode);
+    run.bytes_per_frame = codec2_bytes_per_frame(codec2);
+    run.samples_per_frame = codec2_samples_per_frame(codec2);
+    size_t n_frames = workload.size() / run.samples_per_frame;
+    run.bits.assign(n_frames * run.bytes_per_frame, 0);
+
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < n_frames; ++i)
+      codec2_encode(codec2, &run.bits[i * run.bytes_per_frame],
+                    const_cast<short *>(
+                        &workload[i * run.samples_per_frame]));
+    run.encode_ns = std::min(run.encode_ns, now_ns() - start);
+    codec2_destroy(codec2);
+  }
+
+  const std::vector<uint8_t> &bits = reference ? reference->bits : run.bits;
+  size_t n_frames = bits.size() / run.bytes_per_frame;
+  run.pcm.assign(n_frames * run.samples_per_frame, 0);
+
+  for (int pass = 0; pass < CODEC2_CHECK_PASSES; ++pass) {
+    CODEC2 *codec2 = codec2_create(run.mode);
+
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < n_frames; ++i)
+      codec2_decode(codec2, &run.pcm[i * run.samples_per_frame],
+                    &bits[i * run.bytes_per_frame]);
+    run.decode_ns = std::min(run.decode_ns, now_ns() - start);
+    codec2_destroy(codec2);
+  }
+
+  return run;
+}
+
+template <typename T>
+static void write_vec(std::ofstream &out, const std::vector<T> &v) {
+  uint64_t n = v.size();
+  out.write(reinterpret_cast<const char *>(&n), sizeof(n));
+  out.write(reinterpret_cast<const char *>(v.data()), n * sizeof(T));
+}
+
+template <typename T>
+static void read_vec(std::ifstream &in, std::vector<T> &v) {
+  uint64_t n = 0;
+  in.read(reinterpret_cast<char *>(&n), sizeof(n));
+  if (!in || n > (1u << 28))
+    throw std::runtime_error("Truncated reference file");
+  v.resize(n);
+  in.read(reinterpret_cast<char *>(v.data()), n * sizeof(T));
+}
+
+static void save(const std::string &path, const CheckRun &run) {
+  std::ofstream out(path, std::ios::binary);
+  if (!out)
+    throw std::runtime_error("Cannot open " + path);
+
+  uint32_t header[2] = {CODEC2_CHECK_MAGIC,
+                        static_cast<uint32_t>(run.modes.size())};
+  out.write(reinterpret_cast<const char *>(header), sizeof(header));
+  write_vec(out, std::vector<char>(run.build.begin(), run.build.end()));
+
+  for (const ModeRun &m : run.modes) {
+    out.write(reinterpret_cast<const char *>(&m.mode), sizeof(m.mode));
+    out.write(reinterpret_cast<const char *>(&m.bytes_per_frame),
+              sizeof(m.bytes_per_frame));
+    out.write(reinterpret_cast<const char *>(&m.samples_per_frame),
+              sizeof(m.samples_per_frame));
+    out.write(reinterpret_cast<const char *>(&m.encode_ns),
+              sizeof(m.encode_ns));
+    out.write(reinterpret_cast<const char *>(&m.decode_ns),
+              sizeof(m.decode_ns));
+    write_vec(out, m.bits);
+    write_vec(out, m.pcm);
+  }
+
+  if (!out)
+    throw std::runtime_error("Failed to write " + path);
+}
+
+static CheckRun load(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in)
+    throw std::runtime_error("Cannot open " + path);
+
+  uint32_t header[2] = {};
+  in.read(reinterpret_cast<char *>(header), sizeof(header));
+  if (!in || header[0] != CODEC2_CHECK_MAGIC)
+    throw std::runtime_error(path + " is not a codec2-check reference");
+
+  CheckRun run;
+  std::vector<char> build;
+  read_vec(in, build);
+  run.build.assign(build.begin(), build.end());
+
+  run.modes.resize(header[1]);
+  for (ModeRun &m : run.modes) {
+    in.read(reinterpret_cast<char *>(&m.mode), sizeof(m.mode));
+    in.read(reinterpret_cast<char *>(&m.bytes_per_frame),
+            sizeof(m.bytes_per_frame));
+    in.read(reinterpret_cast<char *>(&m.samples_per_frame),
+            sizeof(m.samples_per_frame));
+    in.read(reinterpret_cast<char *>(&m.encode_ns), sizeof(m.encode_ns));
+    in.read(reinterpret_cast<char *>(&m.decode_ns), sizeof(m.decode_ns));
+    read_vec(in, m.bits);
+    read_vec(in, m.pcm);
+  }
+
+  return run;
+}
+
+// Real time factor of a run over the whole workload
+static double realtime(uint64_t ns) {
+  return CODEC2_CHECK_SECONDS * 1e9 / std::max<uint64_t>(ns, 1);
+}
+
+// Compares one mode against the reference, prints it and returns whether
+// it is within tolerance
+static bool compare(const char *name, const ModeRun &ref,
+                    const ModeRun &run) {
+  if (ref.bytes_per_frame != run.bytes_per_frame ||
+      ref.bits.size() != run.bits.size() ||
+      ref.pcm.size() != run.pcm.size()) {
+    std::cout << "codec2-check: " << name
+              << ": frame layout differs from the reference" << std::endl;
+    return false;
+  }
+
+  size_t n_frames = ref.bits.size() / ref.bytes_per_frame;
+  size_t differ = 0;
+  for (size_t i = 0; i < n_frames; ++i)
+    differ += memcmp(&ref.bits[i * ref.bytes_per_frame],
+                     &run.bits[i * run.bytes_per_frame],
+                     ref.bytes_per_frame) != 0;
+
+  double signal = 0, error = 0;
+  for (size_t i = 0; i < ref.pcm.size(); ++i) {
+    double d = double(ref.pcm[i]) - run.pcm[i];
+    signal += double(ref.pcm[i]) * ref.pcm[i];
+    error += d * d;
+  }
+  double snr = error == 0 ? std::numeric_limits<double>::infinity()
+                          : 10 * std::log10(signal / error);
+
+  bool ok = differ <= CODEC2_CHECK_MAX_FRAMES_DIFF * n_frames &&
+            snr >= CODEC2_CHECK_MIN_SNR_DB;
+
+  std::cout << "codec2-check: " << name << ": " << differ << "/" << n_frames
+            << " frames differ, decode ";
+  if (error == 0)
+    std::cout << "exact";
+  else
+    std::cout << "snr " << snr << " dB";
+  std::cout << ", encode " << realtime(run.encode_ns) << "x real time ("
+            << double(ref.encode_ns) / run.encode_ns << "x), decode "
+            << realtime(run.decode_ns) << "x real time ("
+            << double(ref.decode_ns) / run.decode_ns << "x)"
+            << (ok ? "" : " OUT OF TOLERANCE") << std::endl;
+
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  bool save_mode = argc == 3 && std::string(argv[1]) == "--save";
+  if (argc != 2 && !save_mode) {
+    std::cerr << "usage: codec2-check [--save] FILE" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::string path = argv[argc - 1];
+
+  try {
+    codec2_build_check();
+
+    CheckRun reference;
+    if (!save_mode)
+      reference = load(path);
+    if (!save_mode && reference.modes.size() != CODEC2_MODES_N)
+      throw std::runtime_error(path + " covers different modes");
+
+    std::vector<int16_t> workload = make_workload();
+    CheckRun run;
+    run.build = codec2_build_name();
+    for (int i = 0; i < CODEC2_MODES_N; ++i)
+      run.modes.push_back(
+          run_mode(i, workload, save_mode ? nullptr : &reference.modes[i]));
+
+    if (save_mode) {
+      save(path, run);
+      for (int i = 0; i < CODEC2_MODES_N; ++i)
+        std::cout << "codec2-check: " << mode_names[i] << ": encode "
+                  << realtime(run.modes[i].encode_ns)
+                  << "x real time, decode "
+                  << realtime(run.modes[i].decode_ns) << "x real time"
+                  << std::endl;
+      std::cout << "codec2-check: saved " << run.build << " reference to "
+                << path << std::endl;
+      return EXIT_SUCCESS;
+    }
+
+    std::cout << "codec2-check: " << run.build << " against "
+              << reference.build << std::endl;
+    bool ok = true;
+    for (int i = 0; i < CODEC2_MODES_N; ++i)
+      ok &= compare(mode_names[i], reference.modes[i], run.modes[i]);
+
+    std::cout << "codec2-check: " << (ok ? "PASS" : "FAIL") << std::endl;
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+  } catch (const std::exception &ex) {
+    std::cerr << "Error: " << ex.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,103 @@
+// Time to the first encoded frame of a new session and of a new stream,
+// with fresh codec states from the pre-warmed pool and with states
+// re-created inline. Real sessions are at least SESSION_SILENCE_SAMPLES of
+// silence apart, a second by default. The bench spaces them closer to stay
+// quick, but still further apart than the refill thread's polling period.
+//
+// usage: first-frame-bench [sessions]
+
+#include "data.h"
+#include "encoder.h"
+#include "metrics.h"
+#include "thread_profile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#define FIRST_FRAME_SESSIONS 100
+// Speech frames encoded per session
+#define FIRST_FRAME_SESSION_FRAMES 5
+// Wall time between sessions, the refill thread's window
+#define FIRST_FRAME_GAP_MS (2 * CODEC2_POOL_REFILL_MS)
+
+static PcmData speech_frame(uint32_t session_id, uint32_t piece_id) {
+  PcmData pcm_data;
+  pcm_data.stream_id = 0;
+  pcm_data.session_id = session_id;
+  pcm_data.piece_id = piece_id;
+  pcm_data.samples_n = PCM_SAMPLE_MAX;
+
+  for (uint32_t i = 0; i < PCM_SAMPLE_MAX; ++i) {
+    double t = (piece_id * PCM_SAMPLE_MAX + i) / 8000.0;
+    double v = 0;
+    for (int h = 1; h <= 6; ++h)
+      v += std::sin(2 * M_PI * 140 * h * t) / h;
+    pcm_data.samples[i] = static_cast<int16_t>(6000 * v);
+  }
+
+  return pcm_data;
+}
+
+static void report(const char *what, std::vector<uint64_t> &ns) {
+  std::sort(ns.begin(), ns.end());
+  std::cout << "first-frame-bench: " << what << " n=" << ns.size()
+            << " p50=" << ns[ns.size() / 2] / 1000.0
+            << "us p99=" << ns[ns.size() * 99 / 100] / 1000.0
+            << "us max=" << ns.back() / 1000.0 << "us" << std::endl;
+}
+
+static void run(bool pooled, uint32_t sessions) {
+  const char *name = pooled ? "pool" : "inline";
+  int mode = CODEC2_MODE;
+  std::vector<uint64_t> session_ns;
+  std::vector<uint64_t> steady_ns;
+
+  // A new stream: its encoder is built when the device appears, then the
+  // first frame arrives
+  uint64_t start = metrics_now_ns();
+  Encoder encoder(pooled);
+  PcmData frame = speech_frame(0, 0);
+  encoder.encode(frame, mode);
+  uint64_t stream_ns = metrics_now_ns() - start;
+
+  for (uint32_t s = 1; s <= sessions; ++s) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(FIRST_FRAME_GAP_MS));
+
+    for (uint32_t p = 0; p < FIRST_FRAME_SESSION_FRAMES; ++p) {
+      PcmData pcm_data = speech_frame(s, p);
+      uint64_t t0 = metrics_now_ns();
+      encoder.encode(pcm_data, mode);
+      uint64_t ns = metrics_now_ns() - t0;
+      (p == 0 ? session_ns : steady_ns).push_back(ns);
+    }
+  }
+
+  std::cout << "first-frame-bench: " << name << " new stream "
+            << stream_ns / 1000.0 << "us (encoder setup and first frame), "
+            << "pool misses " << encoder.pool_misses() << std::endl;
+  std::string what = std::string(name) + " session first frame";
+  report(what.c_str(), session_ns);
+  what = std::string(name) + " later frames";
+  report(what.c_str(), steady_ns);
+}
+
+int main(int argc, char **argv) {
+  uint32_t sessions = argc > 1 ? atoi(argv[1]) : FIRST_FRAME_SESSIONS;
+  if (sessions == 0) {
+    std::cerr << "usage: first-frame-bench [sessions]" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Placed like the encoder thread, so the refill thread cannot preempt it
+  thread_profile_apply(ThreadStage::Encoder);
+
+  run(false, sessions);
+  run(true, sessions);
+
+  return EXIT_SUCCESS;
+}
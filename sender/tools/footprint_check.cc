@@ -0,0 +1,87 @@
+// Runs FOOTPRINT_MAX_STREAMS device pipelines over synthetic speech and
+// fails if the arena or the peak RSS outgrew the budget of the static
+// footprint profile. There is no PipeWire client here, so its share of the
+// budget is left out. Runs in a temporary directory, which takes the
+// decoder debugger's recordings and is removed afterwards.
+
+#include "arena.h"
+#include "footprint.h"
+#include "pipeline.h"
+
+#include <unistd.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#define FOOTPRINT_CHECK_SECONDS 20
+
+// Speech-like bursts with pauses long enough to end a session
+static std::vector<int16_t> make_workload() {
+  std::vector<int16_t> samples(FOOTPRINT_CHECK_SECONDS * 8000, 0);
+
+  for (size_t i = 0; i < samples.size(); ++i) {
+    if ((i / 8000) % 5 == 4)
+      continue;
+    double env = 0.5 + 0.5 * std::sin(2 * M_PI * 3 * i / 8000.0);
+    double v = 0;
+    for (int h = 1; h <= 6; ++h)
+      v += std::sin(2 * M_PI * 140 * h * i / 8000.0) / h;
+    samples[i] = static_cast<int16_t>(6000 * env * v);
+  }
+
+  return samples;
+}
+
+int main() {
+  // Before anything the budget covers
+  size_t startup_rss = footprint_rss();
+
+  std::filesystem::path cwd = std::filesystem::current_path();
+  char dir[] = "/tmp/footprint-check-XXXXXX";
+  if (!mkdtemp(dir) || chdir(dir) < 0) {
+    std::cerr << "Error: cannot create a temporary directory" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  FootprintBudget budget = footprint_budget(FOOTPRINT_MAX_STREAMS);
+  arena_init(budget.arena());
+
+  std::vector<int16_t> workload = make_workload();
+
+  {
+    std::vector<std::unique_ptr<DevicePipeline>> pipelines;
+    for (uint32_t i = 0; i < FOOTPRINT_MAX_STREAMS; ++i)
+      pipelines.push_back(std::make_unique<DevicePipeline>(
+          i, "footprint-" + std::to_string(i)));
+
+    // Ten times faster than real time, every pipeline gets the same audio
+    for (size_t off = 0; off < workload.size(); off += PCM_SAMPLE_MAX) {
+      for (auto &pipeline : pipelines)
+        pipeline->framer()->process(&workload[off], PCM_SAMPLE_MAX);
+      std::this_thread::sleep_for(std::chrono::milliseconds(4));
+    }
+
+    footprint_report(budget);
+  }
+
+  std::filesystem::current_path(cwd);
+  std::filesystem::remove_all(dir);
+
+  size_t limit = budget.total() - budget.pipewire;
+  bool ok = startup_rss <= budget.baseline &&
+            arena_used() <= budget.arena() && footprint_peak_rss() <= limit;
+
+  std::cout << "footprint-check: startup rss " << startup_rss / 1024
+            << " of " << budget.baseline / 1024 << " KiB, arena "
+            << arena_used() << " of "
+            << budget.arena() << " bytes, peak rss "
+            << footprint_peak_rss() / 1024 << " of " << limit / 1024
+            << " KiB: " << (ok ? "PASS" : "FAIL") << std::endl;
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
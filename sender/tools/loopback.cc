@@ -0,0 +1,436 @@
+// Plays a reference WAV through the capture framing, Encoder::encode, a
+// simulated lossy link and a jitter buffer, decodes what arrives and scores
+// it against what was captured, once per Codec2 mode. Runs on a virtual
+// clock, so results only depend on the input and the link settings.
+//
+// usage: loopback <reference.wav> [options]
+//   --delay-ms N    one way link delay
+//   --jitter-ms N   extra uniform random delay, 0..N
+//   --loss PCT      independent packet loss
+//   --bitrate BPS   link rate, packets queue behind each other
+//   --overhead N    bytes of framing per packet
+//   --playout-ms N  jitter buffer depth after a session's first packet
+//   --seed N        link randomness
+//   --csv PATH      results, one row per mode (default loopback.csv)
+//   --dtx           run DTX as the encoder stage does, the receiver plays
+//                   comfort noise after SID frames
+
+#include "MsgQueue.h"
+#include "bitrate.h"
+#include "data.h"
+#include "dtx.h"
+#include "encoder.h"
+#include "metrics.h"
+#include "pcm_framer.h"
+#include "wav_file.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#define LOOPBACK_DELAY_MS 80
+#define LOOPBACK_JITTER_MS 40
+#define LOOPBACK_LOSS_PCT 2.0
+#define LOOPBACK_BITRATE 9600
+#define LOOPBACK_OVERHEAD 4
+#define LOOPBACK_PLAYOUT_MS 120
+#define LOOPBACK_SEED 1
+#define LOOPBACK_CSV "loopback.csv"
+
+// Capture callback size fed to the framer, 20 ms
+#define LOOPBACK_CHUNK 160
+// Frames below this level are not scored, the codec output there is noise
+#define LOOPBACK_ACTIVE_DBFS -50.0
+
+#define SAMPLE_NS 125000ull
+
+struct LinkConfig {
+  double delay_ms = LOOPBACK_DELAY_MS;
+  double jitter_ms = LOOPBACK_JITTER_MS;
+  double loss_pct = LOOPBACK_LOSS_PCT;
+  double bitrate = LOOPBACK_BITRATE;
+  uint32_t overhead = LOOPBACK_OVERHEAD;
+  double playout_ms = LOOPBACK_PLAYOUT_MS;
+  uint32_t seed = LOOPBACK_SEED;
+};
+
+struct ModeResult {
+  int mode;
+  uint64_t frames = 0;
+  uint64_t lost = 0;
+  uint64_t late = 0;
+  uint64_t bytes = 0;
+  uint64_t duration_ns = 0;
+  std::vector<double> transit_ms; // capture of the last sample to arrival
+  std::vector<double> mouth_to_ear_ms;
+  double lsd_sum = 0;
+  uint64_t lsd_frames = 0;
+  double snr_sum = 0;
+  // Real time spent in Codec2 encode, and the frames DTX kept from it
+  uint64_t encode_ns = 0;
+  uint64_t sid = 0;
+  uint64_t suppressed = 0;
+};
+
+// Packet delivery of a serial link with a FIFO in front of it
+class LinkSimulator {
+public:
+  explicit LinkSimulator(const LinkConfig &config)
+      : config(config), seed(config.seed) {}
+
+  // Arrival time of a packet handed to the link at ready_ns, or 0 if lost
+  uint64_t send(uint64_t ready_ns, uint32_t n_bytes) {
+    uint64_t start_ns = std::max(ready_ns, free_ns);
+    free_ns = start_ns + static_cast<uint64_t>(
+                             (n_bytes + config.overhead) * 8 * 1e9 /
+                             config.bitrate);
+
+    if (uniform() * 100.0 < config.loss_pct)
+      return 0;
+
+    return free_ns +
+           static_cast<uint64_t>((config.delay_ms +
+                                  uniform() * config.jitter_ms) *
+                                 1e6);
+  }
+
+private:
+  double uniform() {
+    seed = seed * 1664525u + 1013904223u;
+    return seed / 4294967296.0;
+  }
+
+  LinkConfig config;
+  uint32_t seed;
+  uint64_t free_ns = 0;
+};
+
+static double frame_dbfs(const int16_t *samples) {
+  double energy = 0;
+  for (uint32_t i = 0; i < PCM_SAMPLE_MAX; ++i)
+    energy += static_cast<double>(samples[i]) * samples[i];
+  energy /= PCM_SAMPLE_MAX;
+  return 10.0 * std::log10(energy / (32768.0 * 32768.0) + 1e-12);
+}
+
+// Root mean square difference of the Hann windowed log power spectra in
+// dB. Codec2 is parametric and does not keep the waveform, the spectral
+// envelope is what it tries to preserve.
+static double log_spectral_distance(const int16_t *ref, const int16_t *out) {
+  static double window[PCM_SAMPLE_MAX];
+  static double cos_table[PCM_SAMPLE_MAX];
+  static double sin_table[PCM_SAMPLE_MAX];
+  static bool tables = false;
+  if (!tables) {
+    for (uint32_t n = 0; n < PCM_SAMPLE_MAX; ++n) {
+      window[n] = 0.5 - 0.5 * std::cos(2 * M_PI * n / PCM_SAMPLE_MAX);
+      cos_table[n] = std::cos(2 * M_PI * n / PCM_SAMPLE_MAX);
+      sin_table[n] = std::sin(2 * M_PI * n / PCM_SAMPLE_MAX);
+    }
+    tables = true;
+  }
+
+  // Floor at roughly -90 dBFS so silent bins do not dominate
+  const double floor = 1e-9 * 32768.0 * 32768.0 * PCM_SAMPLE_MAX;
+
+  double sum = 0;
+  uint32_t bins = PCM_SAMPLE_MAX / 2 - 1;
+  for (uint32_t k = 1; k <= bins; ++k) {
+    double re_r = 0, im_r = 0, re_o = 0, im_o = 0;
+    for (uint32_t n = 0; n < PCM_SAMPLE_MAX; ++n) {
+      uint32_t t = (k * n) % PCM_SAMPLE_MAX;
+      double r = ref[n] * window[n];
+      double o = out[n] * window[n];
+      re_r += r * cos_table[t];
+      im_r -= r * sin_table[t];
+      re_o += o * cos_table[t];
+      im_o -= o * sin_table[t];
+    }
+    double d = 10.0 * std::log10((re_r * re_r + im_r * im_r + floor) /
+                                 (re_o * re_o + im_o * im_o + floor));
+    sum += d * d;
+  }
+
+  return std::sqrt(sum / bins);
+}
+
+static double segment_snr(const int16_t *ref, const int16_t *out) {
+  double signal = 0, noise = 0;
+  for (uint32_t i = 0; i < PCM_SAMPLE_MAX; ++i) {
+    double d = static_cast<double>(ref[i]) - out[i];
+    signal += static_cast<double>(ref[i]) * ref[i];
+    noise += d * d;
+  }
+  // Usual segmental SNR clamping
+  return std::clamp(10.0 * std::log10((signal + 1) / (noise + 1)), -10.0,
+                    35.0);
+}
+
+static double percentile(std::vector<double> &v, double p) {
+  if (v.empty())
+    return 0;
+  std::sort(v.begin(), v.end());
+  return v[std::min(v.size() - 1, static_cast<size_t>(p * v.size()))];
+}
+
+struct Captured {
+  PcmData pcm;
+  uint64_t captured_ns; // virtual time its last sample was delivered
+  bool suppressed;      // by DTX, never sent
+};
+
+static ModeResult run_mode(int mode, const std::vector<int16_t> &reference,
+                           const LinkConfig &config, bool dtx_on) {
+  ModeResult result;
+  result.mode = mode;
+  result.duration_ns = reference.size() * SAMPLE_NS;
+
+  MsgQueue<PcmData> pcm_queue(64);
+  PcmFramer framer(0, &pcm_queue, metrics_stage("loopback"));
+  Encoder encoder;
+  Encoder decoder(false);
+  LinkSimulator link(config);
+  Dtx dtx;
+  ComfortNoise comfort_noise;
+
+  std::vector<Captured> captured;
+  // (session, piece) -> arrival time
+  std::map<std::pair<uint32_t, uint32_t>, uint64_t> arrivals;
+  std::map<std::pair<uint32_t, uint32_t>, Codec2Data> packets;
+
+  for (size_t off = 0; off < reference.size(); off += LOOPBACK_CHUNK) {
+    uint32_t n = std::min<size_t>(LOOPBACK_CHUNK, reference.size() - off);
+    framer.process(&reference[off], n);
+    uint64_t now_ns = (off + n) * SAMPLE_NS;
+
+    while (pcm_queue.size() > 0) {
+      PcmData pcm = *pcm_queue.recv();
+
+      Dtx::Decision decision =
+          dtx_on ? dtx.update(pcm, *config_current()) : Dtx::Decision::Voice;
+      captured.push_back(
+          {pcm, now_ns, decision == Dtx::Decision::Suppress});
+      if (decision == Dtx::Decision::Suppress) {
+        ++result.suppressed;
+        continue;
+      }
+
+      // Encoding is taken as instant on the virtual clock, its real cost
+      // is only counted
+      Codec2Data packet;
+      if (decision == Dtx::Decision::Sid) {
+        packet = dtx.sid_frame(pcm);
+        ++result.sid;
+      } else {
+        uint64_t start_ns = metrics_now_ns();
+        packet = encoder.encode(pcm, mode);
+        uint64_t encode_ns = metrics_now_ns() - start_ns;
+        result.encode_ns += encode_ns;
+        dtx.add_encoded(encode_ns, packet.n_bytes);
+      }
+
+      result.bytes += packet.n_bytes;
+
+      uint64_t arrival_ns = link.send(now_ns, packet.n_bytes);
+      if (arrival_ns) {
+        auto key = std::make_pair(pcm.session_id, pcm.piece_id);
+        arrivals[key] = arrival_ns;
+        packets[key] = packet;
+      }
+    }
+  }
+
+  // Receiver: each session plays out a fixed delay after its first packet
+  uint32_t session_id = UINT32_MAX;
+  uint64_t anchor_ns = 0;
+  uint32_t anchor_piece = 0;
+  PcmData last = {0};
+  uint32_t concealed_run = 0;
+  // The last packet played was a SID, gaps after it are DTX, not loss
+  bool in_silence = false;
+
+  for (const Captured &frame : captured) {
+    auto key = std::make_pair(frame.pcm.session_id, frame.pcm.piece_id);
+    auto arrival = arrivals.find(key);
+    ++result.frames;
+
+    if (frame.pcm.session_id != session_id && arrival != arrivals.end()) {
+      session_id = frame.pcm.session_id;
+      anchor_ns = arrival->second +
+                  static_cast<uint64_t>(config.playout_ms * 1e6);
+      anchor_piece = frame.pcm.piece_id;
+      concealed_run = 0;
+      in_silence = false;
+    }
+
+    uint64_t playout_ns =
+        anchor_ns + (frame.pcm.piece_id - anchor_piece) * FRAME_PERIOD_NS;
+
+    PcmData out;
+    if (arrival == arrivals.end() && in_silence &&
+        frame.pcm.session_id == session_id) {
+      // Suppressed by DTX, or lost while silent, which sounds the same
+      if (!frame.suppressed)
+        ++result.lost;
+      out = comfort_noise.generate(frame.pcm.stream_id, session_id,
+                                   frame.pcm.piece_id);
+      concealed_run = 0;
+    } else if (arrival == arrivals.end() ||
+               frame.pcm.session_id != session_id ||
+               arrival->second > playout_ns) {
+      // A suppressed frame lands here when the SID before it was lost
+      if (arrival == arrivals.end() && !frame.suppressed)
+        ++result.lost;
+      else if (arrival != arrivals.end())
+        ++result.late;
+
+      // Repeat the last frame once at half level, then go silent
+      out = last;
+      for (uint32_t i = 0; i < PCM_SAMPLE_MAX; ++i)
+        out.samples[i] = concealed_run == 0 ? last.samples[i] / 2 : 0;
+      ++concealed_run;
+    } else {
+      result.transit_ms.push_back((arrival->second - frame.captured_ns) /
+                                  1e6);
+      const Codec2Data &packet = packets.at(key);
+      in_silence = packet.type == FrameType::Sid;
+      if (in_silence) {
+        comfort_noise.set_level(packet.bytes[0]);
+        out = comfort_noise.generate(frame.pcm.stream_id, session_id,
+                                     frame.pcm.piece_id);
+      } else {
+        out = decoder.decode(packets.at(key));
+      }
+      concealed_run = 0;
+    }
+    last = out;
+
+    // From the first sample of the frame being spoken to it being played
+    if (frame.pcm.session_id == session_id)
+      result.mouth_to_ear_ms.push_back(
+          (playout_ns - (frame.captured_ns - FRAME_PERIOD_NS)) / 1e6);
+
+    if (frame_dbfs(frame.pcm.samples) > LOOPBACK_ACTIVE_DBFS) {
+      result.lsd_sum += log_spectral_distance(frame.pcm.samples, out.samples);
+      result.snr_sum += segment_snr(frame.pcm.samples, out.samples);
+      ++result.lsd_frames;
+    }
+  }
+
+  return result;
+}
+
+static bool parse_args(int argc, char **argv, std::string &wav,
+                       std::string &csv, LinkConfig &config, bool &dtx) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg.rfind("--", 0) != 0) {
+      wav = arg;
+      continue;
+    }
+    if (arg == "--dtx") {
+      dtx = true;
+      continue;
+    }
+    if (i + 1 == argc)
+      return false;
+
+    const char *value = argv[++i];
+    if (arg == "--delay-ms")
+      config.delay_ms = atof(value);
+    else if (arg == "--jitter-ms")
+      config.jitter_ms = atof(value);
+    else if (arg == "--loss")
+      config.loss_pct = atof(value);
+    else if (arg == "--bitrate")
+      config.bitrate = atof(value);
+    else if (arg == "--overhead")
+      config.overhead = atoi(value);
+    else if (arg == "--playout-ms")
+      config.playout_ms = atof(value);
+    else if (arg == "--seed")
+      config.seed = atoi(value);
+    else if (arg == "--csv")
+      csv = value;
+    else
+      return false;
+  }
+
+  return !wav.empty() && config.bitrate > 0;
+}
+
+int main(int argc, char **argv) {
+  std::string wav;
+  std::string csv = LOOPBACK_CSV;
+  LinkConfig config;
+  bool dtx = false;
+
+  if (!parse_args(argc, argv, wav, csv, config, dtx)) {
+    std::cerr << "usage: loopback <reference.wav> [--delay-ms N] "
+                 "[--jitter-ms N] [--loss PCT] [--bitrate BPS] "
+                 "[--overhead N] [--playout-ms N] [--seed N] [--csv PATH] "
+                 "[--dtx]"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::vector<ModeResult> results;
+  try {
+    std::vector<int16_t> reference = read_wav(wav);
+    for (int mode : CODEC2_MODES)
+      results.push_back(run_mode(mode, reference, config, dtx));
+  } catch (const std::exception &ex) {
+    std::cerr << "Error: " << ex.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::ofstream out(csv);
+  out << "mode,frames,lost,late,concealed_pct,payload_bps,"
+         "transit_p50_ms,transit_p95_ms,transit_p99_ms,transit_max_ms,"
+         "mouth_to_ear_p50_ms,mouth_to_ear_p95_ms,mouth_to_ear_max_ms,"
+         "lsd_db,segsnr_db,scored_frames,sid,suppressed,encode_cpu_ms\n";
+  out << std::fixed << std::setprecision(2);
+
+  for (ModeResult &r : results) {
+    double concealed = r.frames ? 100.0 * (r.lost + r.late) / r.frames : 0;
+    double lsd = r.lsd_frames ? r.lsd_sum / r.lsd_frames : 0;
+    double snr = r.lsd_frames ? r.snr_sum / r.lsd_frames : 0;
+    double bps = r.duration_ns ? r.bytes * 8 * 1e9 / r.duration_ns : 0;
+
+    out << r.mode << "," << r.frames << "," << r.lost << "," << r.late
+        << "," << concealed << "," << bps << ","
+        << percentile(r.transit_ms, 0.5) << ","
+        << percentile(r.transit_ms, 0.95) << ","
+        << percentile(r.transit_ms, 0.99) << ","
+        << percentile(r.transit_ms, 1.0) << ","
+        << percentile(r.mouth_to_ear_ms, 0.5) << ","
+        << percentile(r.mouth_to_ear_ms, 0.95) << ","
+        << percentile(r.mouth_to_ear_ms, 1.0) << "," << lsd << "," << snr
+        << "," << r.lsd_frames << "," << r.sid << "," << r.suppressed << ","
+        << r.encode_ns / 1e6 << "\n";
+
+    std::cout << "loopback: mode " << r.mode << " frames=" << r.frames
+              << " lost=" << r.lost << " late=" << r.late
+              << " transit_p95=" << percentile(r.transit_ms, 0.95)
+              << "ms mouth_to_ear_p50="
+              << percentile(r.mouth_to_ear_ms, 0.5) << "ms lsd=" << lsd
+              << "dB bps=" << bps << " encode_cpu=" << r.encode_ns / 1e6
+              << "ms" << std::endl;
+    if (dtx)
+      std::cout << "loopback: mode " << r.mode << " dtx sid=" << r.sid
+                << " suppressed=" << r.suppressed << " ("
+                << 100.0 * (r.sid + r.suppressed) / r.frames
+                << "% not encoded)" << std::endl;
+  }
+
+  std::cout << "loopback: results written to " << csv << std::endl;
+  return EXIT_SUCCESS;
+}
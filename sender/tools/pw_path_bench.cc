@@ -0,0 +1,208 @@
+// CPU time and latency of the PipeWire capture path, the counterpart of
+// sbc-ingest-bench. Runs the sender's capture and pipelines against the
+// live bluez5 sources for a while, then reports the CPU the PipeWire daemon,
+// the session manager (which hosts the bluez5 nodes in some setups) and
+// this process used, read from /proc, and the capture latency PipeWire
+// reports through pw_stream_get_time. pw-top shows the same per node, as
+// BUSY and QUANT, for a cross check. The daemon's share covers all of its
+// clients, so nothing else should be playing or recording meanwhile.
+//
+// usage: pw-path-bench [seconds] [--config PATH]
+
+#include "codec2_build.h"
+#include "config.h"
+#include "data.h"
+#include "metrics.h"
+#include "pipeline.h"
+#include "pw-stream.h"
+#include "thread_profile.h"
+
+#include <pthread.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define PW_PATH_BENCH_SECONDS 30
+
+// Processes on the PipeWire side of the path, by /proc/<pid>/comm
+static const char *pw_processes[] = {"pipewire", "wireplumber"};
+
+static void usage() {
+  std::cerr << "usage: pw-path-bench [seconds] [--config PATH]" << std::endl;
+}
+
+// User and system time of every process named comm, in microseconds
+static uint64_t process_cpu_us(const std::string &comm) {
+  uint64_t ticks = 0;
+
+  for (const auto &entry : std::filesystem::directory_iterator("/proc")) {
+    std::string pid = entry.path().filename();
+    if (pid.find_first_not_of("0123456789") != std::string::npos)
+      continue;
+
+    std::string name;
+    std::ifstream(entry.path() / "comm") >> name;
+    if (name != comm)
+      continue;
+
+    // The command name may hold spaces, the fields after it do not
+    std::string stat;
+    std::getline(std::ifstream(entry.path() / "stat"), stat);
+    std::istringstream fields(stat.substr(stat.rfind(')') + 2));
+    std::string skip;
+    uint64_t utime = 0, stime = 0;
+    for (int i = 3; i < 14; ++i)
+      fields >> skip;
+    if (fields >> utime >> stime)
+      ticks += utime + stime;
+  }
+
+  return ticks * 1000000 / sysconf(_SC_CLK_TCK);
+}
+
+static uint64_t self_cpu_us() {
+  rusage ru{};
+  getrusage(RUSAGE_SELF, &ru);
+  return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000ull +
+         ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+// Mean of a histogram over all stages, in seconds, from the metrics text
+static double histogram_mean(const std::string &metrics,
+                             const std::string &name) {
+  std::string sum_key = "sender_" + name + "_sum{";
+  std::string count_key = "sender_" + name + "_count{";
+  double sum = 0, count = 0;
+
+  std::istringstream lines(metrics);
+  std::string line;
+  while (std::getline(lines, line)) {
+    double value = atof(line.substr(line.rfind(' ') + 1).c_str());
+    if (line.rfind(sum_key, 0) == 0)
+      sum += value;
+    else if (line.rfind(count_key, 0) == 0)
+      count += value;
+  }
+
+  return count ? sum / count : 0;
+}
+
+int main(int argc, char **argv) {
+  uint32_t seconds = PW_PATH_BENCH_SECONDS;
+  std::string config_path = CONFIG_PATH;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--config" && i + 1 < argc) {
+      config_path = argv[++i];
+    } else if (arg.find_first_not_of("0123456789") == std::string::npos &&
+               atoi(arg.c_str()) > 0) {
+      seconds = atoi(arg.c_str());
+    } else {
+      usage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::map<std::string, uint64_t> pw_start;
+  std::map<std::string, uint64_t> pw_cpu;
+  std::vector<std::unique_ptr<DevicePipeline>> pipelines;
+  std::string metrics;
+  uint64_t self_cpu = 0;
+  double wall_s = 0;
+
+  try {
+    codec2_build_check();
+    config_init(config_path);
+    thread_profile_lock_memory();
+
+    for (const char *comm : pw_processes)
+      pw_start[comm] = process_cpu_us(comm);
+    uint64_t self_start = self_cpu_us();
+    auto start = std::chrono::steady_clock::now();
+
+    // PipeWire's SIGINT handler ends the run, like Ctrl-C in the sender
+    PwStream pw_stream([&pipelines](uint32_t stream_id,
+                                    const std::string &name) {
+      pipelines.push_back(std::make_unique<DevicePipeline>(stream_id, name));
+      return pipelines.back()->framer();
+    });
+
+    std::mutex done_mutex;
+    std::condition_variable done_cv;
+    bool done = false;
+    pthread_t main_thread = pthread_self();
+    std::thread timer([&] {
+      std::unique_lock<std::mutex> lock(done_mutex);
+      if (!done_cv.wait_for(lock, std::chrono::seconds(seconds),
+                            [&] { return done; }))
+        pthread_kill(main_thread, SIGINT);
+    });
+
+    pw_stream.run();
+    {
+      std::lock_guard<std::mutex> lock(done_mutex);
+      done = true;
+    }
+    done_cv.notify_one();
+    timer.join();
+
+    wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                           start)
+                 .count();
+    self_cpu = self_cpu_us() - self_start;
+    for (const char *comm : pw_processes)
+      pw_cpu[comm] = process_cpu_us(comm) - pw_start[comm];
+
+    // Before the pipelines unregister their stages
+    metrics = MetricsServer::render();
+  } catch (const std::exception &ex) {
+    std::cerr << "Error: " << ex.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  pipelines.clear();
+
+  if (histogram_mean(metrics, "capture_callback_seconds") == 0) {
+    std::cerr << "Error: no audio captured, is a bluez5 source streaming?"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "pw-path-bench: " << wall_s << " s, cpu";
+  for (auto &[comm, cpu] : pw_cpu)
+    std::cout << " " << comm << " " << 100.0 * cpu / 1e6 / wall_s << "%";
+  std::cout << " sender " << 100.0 * self_cpu / 1e6 / wall_s
+            << "% of one core" << std::endl;
+
+  double device_ms =
+      1000 * histogram_mean(metrics, "capture_latency_seconds");
+  double frame_ms = 1000.0 * PCM_SAMPLE_MAX / 8000;
+  double wait_ms = 1000 * histogram_mean(metrics, "queue_wait_seconds");
+  double encode_ms = 1000 * histogram_mean(metrics, "encode_seconds");
+  std::cout << "pw-path-bench: capture callback mean "
+            << 1e6 * histogram_mean(metrics, "capture_callback_seconds")
+            << "us" << std::endl;
+  std::cout << "pw-path-bench: latency " << device_ms
+            << " ms device to callback (pw_stream_get_time), " << frame_ms
+            << " ms PcmData frame, " << wait_ms << " ms queue wait, "
+            << encode_ms << " ms encode: "
+            << device_ms + frame_ms + wait_ms + encode_ms
+            << " ms end to end" << std::endl;
+
+  return EXIT_SUCCESS;
+}
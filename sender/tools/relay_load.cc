@@ -0,0 +1,229 @@
+// Drives a relay with many simulated senders and subscribes to it to
+// measure what comes back. Each sender has its own socket and sender id
+// and sends one 700C frame per stream every frame period, batched with
+// sendmmsg. Start the relay with --subscribe 127.0.0.1:<listen port>.
+//
+// usage: relay-load [--relay ADDR:PORT] [--listen PORT] [--senders N]
+//                   [--streams N] [--seconds N]
+
+#include "bitrate.h"
+#include "packet.h"
+#include "relay.h"
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define RELAY_LOAD_LISTEN_PORT 7301
+#define RELAY_LOAD_SENDERS 8
+// Streams per sender
+#define RELAY_LOAD_STREAMS 64
+#define RELAY_LOAD_SECONDS 10
+// Time for the last packets to come back
+#define RELAY_LOAD_DRAIN_MS 500
+
+struct LoadConfig {
+  sockaddr_in relay{};
+  uint16_t listen_port = RELAY_LOAD_LISTEN_PORT;
+  uint32_t senders = RELAY_LOAD_SENDERS;
+  uint32_t streams = RELAY_LOAD_STREAMS;
+  uint32_t seconds = RELAY_LOAD_SECONDS;
+};
+
+static bool parse_args(int argc, char **argv, LoadConfig &config) {
+  config.relay.sin_family = AF_INET;
+  config.relay.sin_port = htons(RELAY_PORT);
+  config.relay.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (i + 1 == argc)
+      return false;
+
+    std::string value = argv[++i];
+    if (arg == "--relay") {
+      size_t colon = value.rfind(':');
+      if (colon == std::string::npos ||
+          inet_pton(AF_INET, value.substr(0, colon).c_str(),
+                    &config.relay.sin_addr) != 1)
+        return false;
+      config.relay.sin_port = htons(atoi(value.c_str() + colon + 1));
+    } else if (arg == "--listen") {
+      config.listen_port = atoi(value.c_str());
+    } else if (arg == "--senders") {
+      config.senders = atoi(value.c_str());
+    } else if (arg == "--streams") {
+      config.streams = atoi(value.c_str());
+    } else if (arg == "--seconds") {
+      config.seconds = atoi(value.c_str());
+    } else {
+      return false;
+    }
+  }
+
+  return config.senders > 0 && config.streams > 0;
+}
+
+// Receives from the relay until stopped, keeping one-way latencies in us
+static void receive(int fd, const std::atomic<bool> &running,
+                    uint64_t &received, std::vector<uint32_t> &latency_us) {
+  std::vector<uint8_t> bufs(RELAY_BATCH * (PACKET_SIZE_MAX + 1));
+  iovec iov[RELAY_BATCH];
+  mmsghdr msgs[RELAY_BATCH];
+  for (uint32_t i = 0; i < RELAY_BATCH; ++i) {
+    iov[i] = {&bufs[i * (PACKET_SIZE_MAX + 1)], PACKET_SIZE_MAX + 1};
+    msgs[i].msg_hdr = {};
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  while (running) {
+    int n = recvmmsg(fd, msgs, RELAY_BATCH, MSG_WAITFORONE, nullptr);
+    if (n <= 0)
+      continue;
+
+    uint64_t now_ns = packet_now_ns();
+    for (int i = 0; i < n; ++i) {
+      Packet packet;
+      if (!packet_decode(static_cast<uint8_t *>(iov[i].iov_base),
+                         msgs[i].msg_len, packet))
+        continue;
+      ++received;
+      latency_us.push_back((now_ns - packet.sent_ns) / 1000);
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  LoadConfig config;
+  if (!parse_args(argc, argv, config)) {
+    std::cerr << "usage: relay-load [--relay ADDR:PORT] [--listen PORT] "
+                 "[--senders N] [--streams N] [--seconds N]"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  int listen_fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  sockaddr_in listen_addr{};
+  listen_addr.sin_family = AF_INET;
+  listen_addr.sin_port = htons(config.listen_port);
+  listen_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  int rcvbuf = 8 * 1024 * 1024;
+  timeval timeout = {0, RELAY_POLL_MS * 1000};
+  setsockopt(listen_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  setsockopt(listen_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  if (bind(listen_fd, reinterpret_cast<sockaddr *>(&listen_addr),
+           sizeof(listen_addr)) < 0) {
+    std::cerr << "Error: cannot listen on port " << config.listen_port << ": "
+              << strerror(errno) << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::vector<int> sender_fds;
+  for (uint32_t s = 0; s < config.senders; ++s) {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr *>(&config.relay),
+                          sizeof(config.relay)) < 0) {
+      std::cerr << "Error: cannot reach the relay: " << strerror(errno)
+                << std::endl;
+      return EXIT_FAILURE;
+    }
+    sender_fds.push_back(fd);
+  }
+
+  std::atomic<bool> running = true;
+  uint64_t received = 0;
+  std::vector<uint32_t> latency_us;
+  latency_us.reserve(static_cast<size_t>(config.senders) * config.streams *
+                     config.seconds * (1000000000ull / FRAME_PERIOD_NS));
+  std::thread receiver([&] {
+    receive(listen_fd, running, received, latency_us);
+  });
+
+  // One packet per stream, resent every period with a new piece id
+  std::vector<uint8_t> bufs(config.streams * PACKET_SIZE_MAX);
+  std::vector<iovec> iov(config.streams);
+  std::vector<mmsghdr> msgs(config.streams);
+
+  uint64_t sent = 0;
+  uint64_t periods = config.seconds * 1000000000ull / FRAME_PERIOD_NS;
+  auto start = std::chrono::steady_clock::now();
+
+  for (uint64_t period = 0; period < periods; ++period) {
+    for (uint32_t s = 0; s < config.senders; ++s) {
+      for (uint32_t i = 0; i < config.streams; ++i) {
+        Packet packet;
+        packet.sender_id = 0x5e000000 + s;
+        packet.data.stream_id = i;
+        packet.data.session_id = 1;
+        packet.data.piece_id = period;
+        packet.data.type = FrameType::Voice;
+        packet.data.mode = CODEC2_MODE_700C;
+        packet.data.n_bytes = 4;
+        memset(packet.data.bytes, 0x5a, packet.data.n_bytes);
+        packet.sent_ns = packet_now_ns();
+
+        uint8_t *buf = &bufs[i * PACKET_SIZE_MAX];
+        iov[i] = {buf, packet_encode(packet, buf)};
+        msgs[i].msg_hdr = {};
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+      }
+
+      uint32_t done = 0;
+      while (done < config.streams) {
+        int n = sendmmsg(sender_fds[s], &msgs[done], config.streams - done,
+                         0);
+        if (n <= 0)
+          break;
+        done += n;
+      }
+      sent += done;
+    }
+
+    std::this_thread::sleep_until(
+        start + std::chrono::nanoseconds((period + 1) * FRAME_PERIOD_NS));
+  }
+
+  double elapsed_s = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(RELAY_LOAD_DRAIN_MS));
+  running = false;
+  receiver.join();
+
+  for (int fd : sender_fds)
+    close(fd);
+  close(listen_fd);
+
+  std::sort(latency_us.begin(), latency_us.end());
+  auto pct = [&](double p) -> uint32_t {
+    if (latency_us.empty())
+      return 0;
+    return latency_us[std::min(latency_us.size() - 1,
+                               static_cast<size_t>(p * latency_us.size()))];
+  };
+
+  std::cout << "relay-load: " << config.senders * config.streams
+            << " streams, sent " << sent << " (" << sent / elapsed_s
+            << "/s), received " << received << " ("
+            << received / elapsed_s << "/s), lost "
+            << (sent ? 100.0 * (sent - std::min(sent, received)) / sent : 0)
+            << "%" << std::endl;
+  std::cout << "relay-load: latency p50=" << pct(0.5)
+            << "us p99=" << pct(0.99) << "us p99.9=" << pct(0.999)
+            << "us max=" << pct(1.0) << "us" << std::endl;
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,117 @@
+// Replays a synthetic conversation through the capture framing and the
+// encoder loop with malloc/free and blocking libc calls interposed, and
+// fails if either real-time path made one.
+
+#include "MsgQueue.h"
+#include "data.h"
+#include "encoder_stage.h"
+#include "metrics.h"
+#include "pcm_framer.h"
+#include "rt_guard.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#define RT_CHECK_SECONDS 30
+
+// Talk spurts separated by short pauses (DTX) and long ones (new session)
+static std::vector<int16_t> make_workload() {
+  std::vector<int16_t> samples;
+  samples.reserve(RT_CHECK_SECONDS * 8000);
+
+  uint32_t seed = 1;
+  uint32_t t = 0;
+  while (samples.size() < RT_CHECK_SECONDS * 8000u) {
+    uint32_t talk = 8000 * (1 + t % 3);
+    for (uint32_t i = 0; i < talk; ++i) {
+      double env = 0.5 + 0.5 * std::sin(2 * M_PI * 3 * i / 8000.0);
+      double f0 = 120 + 40 * std::sin(2 * M_PI * 0.5 * i / 8000.0);
+      double v = 0;
+      for (int h = 1; h <= 8; ++h)
+        v += std::sin(2 * M_PI * f0 * h * i / 8000.0) / h;
+      seed = seed * 1664525u + 1013904223u;
+      v += (static_cast<int32_t>(seed) / 2147483648.0) * 0.05;
+      samples.push_back(static_cast<int16_t>(6000 * env * v));
+    }
+
+    uint32_t pause = (t % 4 == 3) ? 12000 : 3000;
+    samples.insert(samples.end(), pause, 0);
+    ++t;
+  }
+
+  return samples;
+}
+
+static bool check(const char *stage, const RtViolations &v) {
+  std::cout << "rt-check: " << stage << " allocations=" << v.allocations
+            << " blocking_calls=" << v.blocking_calls;
+  if (v.first)
+    std::cout << " first=" << v.first;
+  std::cout << std::endl;
+
+  return v.allocations == 0 && v.blocking_calls == 0;
+}
+
+int main() {
+  MsgQueue<PcmData> pcm_queue(64);
+  MsgQueue<Codec2Data> codec2_queue(64);
+
+  std::vector<int16_t> workload = make_workload();
+  RtViolations encoder_violations = {};
+
+  std::thread encoder_worker([&] {
+    EncoderStage encoder_stage(&pcm_queue, &codec2_queue,
+                               metrics_stage("encoder"));
+
+    while (auto maybe_data = pcm_queue.recv()) {
+      PcmData data = std::move(*maybe_data);
+      RtSection rt;
+      encoder_stage.process(data);
+    }
+
+    encoder_violations = rt_violations();
+    codec2_queue.close();
+  });
+
+  std::thread sink([&] {
+    while (codec2_queue.recv()) {
+    }
+  });
+
+  PcmFramer framer(0, &pcm_queue, metrics_stage("capture"));
+
+  // Chunk sizes PipeWire commonly delivers, cycled to exercise every
+  // partial-frame path of the framer
+  static const uint32_t chunks[] = {256, 512, 1024, 160, 333, 80};
+  size_t off = 0;
+  for (size_t i = 0; off < workload.size(); ++i) {
+    uint32_t n = chunks[i % std::size(chunks)];
+    if (n > workload.size() - off)
+      n = workload.size() - off;
+
+    // Keep the encoder fed without overflowing its queue
+    while (pcm_queue.size() > pcm_queue.capacity() / 2)
+      std::this_thread::yield();
+
+    {
+      RtSection rt;
+      framer.process(&workload[off], n);
+    }
+    off += n;
+  }
+
+  RtViolations capture_violations = rt_violations();
+
+  pcm_queue.close();
+  encoder_worker.join();
+  sink.join();
+
+  bool ok = check("capture", capture_violations);
+  ok = check("encoder", encoder_violations) && ok;
+
+  std::cout << "rt-check: " << (ok ? "PASS" : "FAIL") << std::endl;
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,148 @@
+// CPU time and latency of the direct SBC ingest path: decode, mix down,
+// resample and frame, per SBC frame. Input is a .sbc file, or ten seconds
+// of a voice-like signal encoded with the usual A2DP settings (44.1 kHz
+// joint stereo, 16 blocks, 8 subbands, bitpool 53). The per-frame numbers
+// print in the format of capture-replay's "capture callback" line, which
+// is what the PipeWire path costs once PipeWire has decoded and resampled.
+//
+// usage: sbc-ingest-bench [file.sbc]
+
+#include "MsgQueue.h"
+#include "metrics.h"
+#include "pcm_framer.h"
+#include "sbc_ingest.h"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+#define SBC_BENCH_SECONDS 10
+#define SBC_BENCH_RATE 44100
+#define SBC_BENCH_BITPOOL 53
+
+// Syllable-rate bursts of a few harmonics, stereo with a small offset
+static std::vector<uint8_t> synthesize() {
+  sbc_t sbc;
+  if (sbc_init(&sbc, 0) < 0)
+    throw std::runtime_error("Failed to initialize the SBC encoder");
+  sbc.frequency = SBC_FREQ_44100;
+  sbc.mode = SBC_MODE_JOINT_STEREO;
+  sbc.blocks = SBC_BLK_16;
+  sbc.subbands = SBC_SB_8;
+  sbc.allocation = SBC_AM_LOUDNESS;
+  sbc.bitpool = SBC_BENCH_BITPOOL;
+
+  size_t codesize = sbc_get_codesize(&sbc);
+  size_t n_frames = codesize / 4;
+  std::vector<int16_t> pcm(n_frames * 2);
+  std::vector<uint8_t> out(SBC_INGEST_FRAME_MAX);
+  std::vector<uint8_t> sbc_data;
+
+  uint64_t t = 0;
+  for (uint64_t total = 0; total < SBC_BENCH_SECONDS * SBC_BENCH_RATE;
+       total += n_frames) {
+    for (size_t i = 0; i < n_frames; ++i, ++t) {
+      double s = t / double(SBC_BENCH_RATE);
+      double envelope = std::max(0.0, std::sin(2 * M_PI * 4 * s));
+      double v = 0;
+      for (int h = 1; h <= 5; ++h)
+        v += std::sin(2 * M_PI * 150 * h * s) / h;
+      int16_t sample = static_cast<int16_t>(6000 * envelope * v);
+      pcm[2 * i] = sample;
+      pcm[2 * i + 1] = sample / 2;
+    }
+
+    ssize_t written = 0;
+    if (sbc_encode(&sbc, pcm.data(), codesize, out.data(), out.size(),
+                   &written) < 0)
+      throw std::runtime_error("SBC encode failed");
+    sbc_data.insert(sbc_data.end(), out.begin(), out.begin() + written);
+  }
+
+  sbc_finish(&sbc);
+  return sbc_data;
+}
+
+static uint64_t cpu_us() {
+  rusage ru{};
+  getrusage(RUSAGE_THREAD, &ru);
+  return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000ull +
+         ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+int main(int argc, char **argv) {
+  std::vector<uint8_t> data;
+  try {
+    if (argc > 1) {
+      std::ifstream file(argv[1], std::ios::binary);
+      if (!file)
+        throw std::runtime_error(std::string("Cannot open ") + argv[1]);
+      data.assign(std::istreambuf_iterator<char>(file), {});
+    } else {
+      data = synthesize();
+    }
+  } catch (const std::exception &ex) {
+    std::cerr << "Error: " << ex.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  MsgQueue<PcmData> pcm_queue(64);
+  PcmFramer framer(0, &pcm_queue, metrics_stage("capture:sbc-bench"));
+  SbcIngest ingest(&framer);
+
+  // Frame length from the first header, every frame of a stream has it
+  sbc_t parser;
+  sbc_init(&parser, 0);
+  if (data.empty() || sbc_parse(&parser, data.data(), data.size()) < 0) {
+    std::cerr << "Error: no SBC frame found" << std::endl;
+    return EXIT_FAILURE;
+  }
+  size_t frame_len = sbc_get_frame_length(&parser);
+  double frame_ms = sbc_get_frame_duration(&parser) / 1000.0;
+  sbc_finish(&parser);
+
+  std::vector<uint64_t> frame_ns;
+  uint64_t pcm_frames = 0;
+  uint64_t cpu_start = cpu_us();
+
+  for (size_t off = 0; off < data.size(); off += frame_len) {
+    uint64_t t0 = metrics_now_ns();
+    ingest.feed_frames(&data[off], std::min(frame_len, data.size() - off));
+    frame_ns.push_back(metrics_now_ns() - t0);
+
+    while (pcm_queue.size() != 0) {
+      pcm_queue.recv();
+      ++pcm_frames;
+    }
+  }
+
+  uint64_t cpu = cpu_us() - cpu_start;
+  double audio_s = ingest.samples_out() / 8000.0;
+
+  std::sort(frame_ns.begin(), frame_ns.end());
+  uint64_t sum = 0;
+  for (uint64_t v : frame_ns)
+    sum += v;
+
+  ingest.report();
+  std::cout << "sbc-ingest-bench: " << audio_s << " s of audio, "
+            << pcm_frames << " PcmData frames, cpu " << cpu / 1000.0
+            << " ms (" << 100.0 * cpu / 1e6 / audio_s << "% of one core)"
+            << std::endl;
+  std::cout << "sbc-ingest-bench: sbc frame n=" << frame_ns.size()
+            << " mean=" << sum / frame_ns.size() / 1000.0
+            << "us p50=" << frame_ns[frame_ns.size() / 2] / 1000.0
+            << "us p99=" << frame_ns[frame_ns.size() * 99 / 100] / 1000.0
+            << "us max=" << frame_ns.back() / 1000.0 << "us" << std::endl;
+  std::cout << "sbc-ingest-bench: added latency " << frame_ms
+            << " ms SBC frame + " << ingest.delay_ms()
+            << " ms filter, then the 40 ms PcmData frame" << std::endl;
+
+  return EXIT_SUCCESS;
+}